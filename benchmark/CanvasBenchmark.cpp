@@ -0,0 +1,279 @@
+// Micro-benchmarks of buffer level drawing, needs only headers of source/ and no Windows.h, so it runs on any platform
+//
+// Build:   g++ -O2 -std=c++17 -I<folder with stf/> CanvasBenchmark.cpp -o CanvasBenchmark
+//          cl /O2 /std:c++17 /EHsc /I<folder with stf/> CanvasBenchmark.cpp
+//          where stf/ holds the files of source/
+// Run:     CanvasBenchmark                                  print written cells per second of every case
+//          CanvasBenchmark --write-baseline baseline.txt    record results of this machine
+//          CanvasBenchmark --baseline baseline.txt          fail if any case is slower than the recorded results
+//          Results depend on the machine, so baseline is recorded locally and isn't kept in the repository
+//          --tolerance 0.25                                 allowed slowdown against baseline
+//          --filter rect                                    run only cases containing the text
+
+#include <stf/Canvas.h>
+#include <stf/SubCell.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+
+#define CE_BENCH_MIN_TIME 0.02      // Seconds of one measurement
+#define CE_BENCH_REPEATS 3          // Measurements per case, the best one is reported
+
+struct ScreenSize { int Width, Height; };
+static const ScreenSize Screens[] = { { 80, 25 }, { 160, 50 }, { 320, 90 }, { 480, 135 } };
+static const int ShapeSizes[] = { 4, 16, 64 };
+
+enum class CLIP_CASE { INSIDE, PARTIAL, OFFSCREEN };
+static const char* ClipNames[] = { "inside", "partial", "offscreen" };
+
+// Draw call of a primitive with top left corner (x,y) and size
+typedef std::function<void(Canvas&, int x, int y, int Size)> Primitive;
+
+struct Scratch
+{
+    std::vector<Pixel> Span, Block;
+    std::vector<int> X, Y;
+    std::wstring Text;
+    RenderTarget Sprite;
+    SubCellBuffer HalfBlocks, Quadrants{ 0, 0, SUBCELL_MODE::QUADRANT };
+};
+static Scratch Data;
+
+// Size x Size cells of noise, kept while size is the same
+static void Prepare(SubCellBuffer& Buffer, SUBCELL_MODE Mode, int Size)
+{
+    if (Buffer.Columns() == Size)
+        return;
+    Buffer.Resize(Size, Size, Mode);
+    for (int y = 0; y < Buffer.Height(); ++y)
+        for (int x = 0; x < Buffer.Width(); ++x)
+            Buffer.DrawPixel(x, y, (short)((x * 7 + y * 13) % 16));
+}
+
+static std::vector<std::pair<const char*, Primitive>> Primitives()
+{
+    return
+    {
+        { "pixel", [](Canvas& c, int x, int y, int Size)
+            {
+                for (int row = 0; row < Size; ++row)
+                    for (int column = 0; column < Size; ++column)
+                        c.DrawPixel(x + column, y + row, L'.', FG_YELLOW);
+            } },
+        { "rect", [](Canvas& c, int x, int y, int Size)
+            {
+                c.DrawRect(x, y, x + Size, y + Size, QUAD::SOLID, FG_WHITE);
+            } },
+        { "box", [](Canvas& c, int x, int y, int Size)
+            {
+                c.DrawBox(x, y, Size, Size, QUAD::SOLID, FG_WHITE);
+            } },
+        { "fill_circle", [](Canvas& c, int x, int y, int Size)
+            {
+                c.DrawFillCircle(x + Size / 2, y + Size / 2, Size / 2, QUAD::SOLID, FG_RED);
+            } },
+        { "circle", [](Canvas& c, int x, int y, int Size)
+            {
+                c.DrawCircle(x + Size / 2, y + Size / 2, Size / 2, L'o', FG_GREEN);
+            } },
+        { "line", [](Canvas& c, int x, int y, int Size)
+            {
+                c.DrawLine(x, y, x + Size - 1, y + Size / 2, L'*', FG_CYAN);
+            } },
+        { "span", [](Canvas& c, int x, int y, int Size)
+            {
+                for (int row = 0; row < Size; ++row)
+                    c.DrawSpan(x, y + row, Data.Span.data(), Size);
+            } },
+        { "string", [](Canvas& c, int x, int y, int Size)
+            {
+                // Resized only when size changes, so measured calls don't allocate
+                if (Data.Text.size() != (size_t)Size)
+                    Data.Text.assign(Size, L'A');
+                for (int row = 0; row < Size; ++row)
+                    c.DrawString(x, y + row, Data.Text, FG_GREEN);
+            } },
+        { "screen_buffer", [](Canvas& c, int x, int y, int Size)
+            {
+                // First Size x Size cells of the block are read as a buffer of that width
+                c.DrawScreenBuffer(x, y, Size, Size, Data.Block.data());
+            } },
+        { "pixels", [](Canvas& c, int x, int y, int Size)
+            {
+                size_t count = (size_t)Size * Size;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    Data.X[i] = x + (int)(i % Size);
+                    Data.Y[i] = y + (int)(i / Size);
+                }
+                c.DrawPixels(Data.X.data(), Data.Y.data(), count, L'.', FG_YELLOW);
+            } },
+        { "composite", [](Canvas& c, int x, int y, int Size)
+            {
+                Data.Sprite.Composite(c.GetRenderTarget(), x, y, 0, 0, Size, Size);
+            } },
+        { "shade", [](Canvas& c, int x, int y, int Size)
+            {
+                c.SetDrawMode(DRAW_MODE::SHADE);
+                c.DrawRect(x, y, x + Size, y + Size, QUAD::HALF, FG_BLUE);
+                c.SetDrawMode(DRAW_MODE::OVERWRITE);
+            } },
+        { "half_block", [](Canvas& c, int x, int y, int Size)
+            {
+                Prepare(Data.HalfBlocks, Data.HalfBlocks.Mode(), Size);
+                Data.HalfBlocks.Resolve(c.GetRenderTarget(), x, y);
+            } },
+        { "quadrant", [](Canvas& c, int x, int y, int Size)
+            {
+                Prepare(Data.Quadrants, Data.Quadrants.Mode(), Size);
+                Data.Quadrants.Resolve(c.GetRenderTarget(), x, y);
+            } },
+        { "noise", [](Canvas& c, int x, int y, int Size)
+            {
+                c.FillRandom(x, y, x + Size, y + Size, L'#', 0x00FF);
+            } },
+    };
+}
+
+static void Place(CLIP_CASE Clip, const ScreenSize& Screen, int Size, int& x, int& y)
+{
+    switch (Clip)
+    {
+    case CLIP_CASE::INSIDE: x = (Screen.Width - Size) / 2; y = (Screen.Height - Size) / 2; break;
+    case CLIP_CASE::PARTIAL: x = Screen.Width - Size / 2; y = Screen.Height - Size / 2; break;
+    case CLIP_CASE::OFFSCREEN: x = -2 * Size; y = Screen.Height + Size; break;
+    }
+}
+
+// Cells one call really writes, found by drawing once over marker cells, so clipped cells don't count
+static size_t WrittenCells(Canvas& Target, const Primitive& Draw, int x, int y, int Size)
+{
+    RenderTarget& target = Target.GetRenderTarget();
+    target.Clear((short)0xFFFF, (short)0xFFFF);
+    Draw(Target, x, y, Size);
+    size_t written = 0;
+    for (int i = 0; i < target.Width() * target.Height(); ++i)
+        written += target.Data()[i].Char.UnicodeChar != 0xFFFF || target.Data()[i].Attributes != 0xFFFF;
+    return written;
+}
+
+// Best calls per second over several measurements
+static double Measure(Canvas& Target, const Primitive& Draw, int x, int y, int Size)
+{
+    using Clock = std::chrono::steady_clock;
+    double best = 0.0;
+    for (int repeat = 0; repeat < CE_BENCH_REPEATS; ++repeat)
+    {
+        size_t calls = 0;
+        auto begin = Clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            for (int i = 0; i < 16; ++i)
+                Draw(Target, x, y, Size);
+            calls += 16;
+            elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+        } while (elapsed < CE_BENCH_MIN_TIME);
+        best = std::max(best, calls / elapsed);
+    }
+    return best;
+}
+
+static std::map<std::string, double> ReadBaseline(const char* Path)
+{
+    std::map<std::string, double> result;
+    std::ifstream file(Path);
+    std::string name;
+    double value;
+    while (file >> name >> value)
+        result[name] = value;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    const char* baseline_path = nullptr;
+    const char* write_path = nullptr;
+    const char* filter = nullptr;
+    double tolerance = 0.25;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--baseline")) baseline_path = argv[i + 1];
+        else if (!strcmp(argv[i], "--write-baseline")) write_path = argv[i + 1];
+        else if (!strcmp(argv[i], "--tolerance")) tolerance = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--filter")) filter = argv[i + 1];
+    }
+
+    const int max_size = ShapeSizes[sizeof(ShapeSizes) / sizeof(ShapeSizes[0]) - 1];
+    Pixel pixel;
+    pixel.Char.UnicodeChar = L'#';
+    pixel.Attributes = FG_MAGENTA;
+    Data.Span.assign(max_size, pixel);
+    Data.Block.assign(max_size * max_size, pixel);
+    Data.X.resize(max_size * max_size);
+    Data.Y.resize(max_size * max_size);
+    // Every third sprite cell is transparent
+    Pixel blank = pixel;
+    blank.Char.UnicodeChar = L' ';
+    Data.Sprite.Resize(max_size, max_size);
+    for (int i = 0; i < max_size * max_size; ++i)
+        Data.Sprite.Data()[i] = (i % 3) ? pixel : blank;
+
+    std::map<std::string, double> baseline;
+    if (baseline_path)
+        baseline = ReadBaseline(baseline_path);
+
+    std::ofstream output;
+    if (write_path)
+        output.open(write_path);
+
+    int regressions = 0;
+    printf("%-36s %16s %6s %10s\n", "case", "per second", "of", "baseline");
+    for (const ScreenSize& screen : Screens)
+    {
+        RenderTarget target(screen.Width, screen.Height);
+        Canvas canvas(&target);
+        for (auto& primitive : Primitives())
+            for (int size : ShapeSizes)
+                for (int clip = 0; clip < 3; ++clip)
+                {
+                    // Shapes larger than screen can't be inside it
+                    if ((CLIP_CASE)clip == CLIP_CASE::INSIDE && (size > screen.Width || size > screen.Height))
+                        continue;
+
+                    char name[128];
+                    snprintf(name, sizeof(name), "%s/%dx%d/%d/%s", primitive.first, screen.Width, screen.Height, size, ClipNames[clip]);
+                    if (filter && !strstr(name, filter))
+                        continue;
+
+                    int x, y;
+                    Place((CLIP_CASE)clip, screen, size, x, y);
+                    // Cases that write nothing, e.g. offscreen ones, measure the early out in calls
+                    const size_t written = WrittenCells(canvas, primitive.second, x, y, size);
+                    const double speed = Measure(canvas, primitive.second, x, y, size) * (written ? written : 1);
+                    const char* unit = written ? "cells" : "calls";
+
+                    auto expected = baseline.find(name);
+                    bool slower = expected != baseline.end() && speed < expected->second * (1.0 - tolerance);
+                    regressions += slower;
+                    if (expected != baseline.end())
+                        printf("%-36s %16.0f %6s %9.0f%%%s\n", name, speed, unit, 100.0 * speed / expected->second, slower ? "  REGRESSION" : "");
+                    else
+                        printf("%-36s %16.0f %6s %10s\n", name, speed, unit, "-");
+                    if (write_path)
+                        output << name << ' ' << (long long)speed << '\n';
+                }
+    }
+
+    if (regressions)
+        printf("%d cases are slower than baseline by more than %.0f%%\n", regressions, tolerance * 100.0);
+    return regressions ? 1 : 0;
+}
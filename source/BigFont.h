@@ -0,0 +1,320 @@
+#pragma once
+
+#include <stf/Canvas.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+/* Large lettering made of many cells. Glyphs are rasterized once into one strip of cells
+   together with runs of their visible cells, so drawing is a few clipped row copies per glyph */
+class BigFont
+{
+public:
+    BigFont() = default;
+
+    int Height() const { return m_Height; }
+    // Empty columns between glyphs
+    void SetSpacing(int Columns) { m_Spacing = Columns; ++m_Version; }
+    int Spacing() const { return m_Spacing; }
+    // Changes on every load, so caches of rendered text know they are stale
+    uint32_t Version() const { return m_Version; }
+
+    /* Loading */
+public:
+    ///<summary> Load FIGlet font from .flf text, hardblanks become opaque spaces </summary>
+    ///<remarks> Glyphs are placed at full width, FIGlet smushing is not applied </remarks>
+    bool LoadFiglet(const std::string& Text)
+    {
+        std::istringstream input(Text);
+        std::string line;
+        if (!std::getline(input, line) || line.compare(0, 5, "flf2a") != 0 || line.size() < 6)
+            return false;
+        const char hardblank = line[5];
+        // Height, baseline, max length, old layout and comment lines follow the hardblank
+        int header[5];
+        const char* cursor = line.c_str() + 6;
+        for (int& value : header)
+        {
+            char* end = nullptr;
+            value = (int)strtol(cursor, &end, 10);
+            if (end == cursor)
+                return false;
+            cursor = end;
+        }
+        const int height = header[0], comments = header[4];
+        if (height <= 0)
+            return false;
+        for (int i = 0; i < comments; ++i)
+            std::getline(input, line);
+
+        Reset(height);
+        std::vector<std::string> rows(height);
+        auto read_glyph = [&]() -> bool
+        {
+            for (int row = 0; row < height; ++row)
+            {
+                if (!std::getline(input, line))
+                    return false;
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                // Line ends with end marks, the last line of glyph has two
+                const char mark = line.empty() ? 0 : line.back();
+                while (!line.empty() && line.back() == mark)
+                    line.pop_back();
+                rows[row] = line;
+            }
+            return true;
+        };
+        auto add_glyph = [&](wchar_t Code)
+        {
+            int width = 0;
+            for (const std::string& row : rows)
+                width = std::max(width, (int)row.size());
+            std::vector<wchar_t> cells((size_t)width * height, 0);
+            for (int row = 0; row < height; ++row)
+                for (int x = 0; x < (int)rows[row].size(); ++x)
+                {
+                    const char c = rows[row][x];
+                    cells[(size_t)row * width + x] = c == hardblank ? L' ' : c == ' ' ? 0 : (wchar_t)(unsigned char)c;
+                }
+            AddGlyph(Code, width, cells.data());
+        };
+
+        // Required characters are ASCII 32-126 and seven German letters, then code tagged ones
+        static const wchar_t german[] = { 196, 214, 220, 228, 246, 252, 223 };
+        for (int code = 32; code < 127; ++code)
+        {
+            if (!read_glyph())
+                return false;
+            add_glyph((wchar_t)code);
+        }
+        for (wchar_t code : german)
+        {
+            if (!read_glyph())
+                return true;
+            add_glyph(code);
+        }
+        while (std::getline(input, line))
+        {
+            long code = strtol(line.c_str(), nullptr, 0);
+            if (!read_glyph())
+                break;
+            if (code > 0 && code <= 0xFFFF)
+                add_glyph((wchar_t)code);
+        }
+        return true;
+    }
+    bool LoadFigletFile(const char* Path)
+    {
+        std::ifstream file(Path, std::ios::binary);
+        if (!file)
+            return false;
+        std::stringstream content;
+        content << file.rdbuf();
+        return LoadFiglet(content.str());
+    }
+
+    ///<summary> Built in 3x5 font of digits, latin letters and some punctuation </summary>
+    ///<param name="PixelWidth"> Cells of one font pixel, two wide look square with usual fonts </param>
+    void LoadBlocks(int PixelWidth = 2, int PixelHeight = 1, short Character = QUAD::SOLID)
+    {
+        static const struct { char Code; const char* Bits; } glyphs[] =
+        {
+            { '0', "111101101101111" }, { '1', "010110010010111" }, { '2', "111001111100111" }, { '3', "111001111001111" },
+            { '4', "101101111001001" }, { '5', "111100111001111" }, { '6', "111100111101111" }, { '7', "111001001001001" },
+            { '8', "111101111101111" }, { '9', "111101111001111" }, { 'A', "010101111101101" }, { 'B', "110101110101110" },
+            { 'C', "011100100100011" }, { 'D', "110101101101110" }, { 'E', "111100110100111" }, { 'F', "111100110100100" },
+            { 'G', "011100101101011" }, { 'H', "101101111101101" }, { 'I', "111010010010111" }, { 'J', "001001001101010" },
+            { 'K', "101101110101101" }, { 'L', "100100100100111" }, { 'M', "101111111101101" }, { 'N', "110101101101101" },
+            { 'O', "010101101101010" }, { 'P', "110101110100100" }, { 'Q', "010101101110011" }, { 'R', "110101110101101" },
+            { 'S', "011100010001110" }, { 'T', "111010010010010" }, { 'U', "101101101101111" }, { 'V', "101101101101010" },
+            { 'W', "101101111111101" }, { 'X', "101101010101101" }, { 'Y', "101101010010010" }, { 'Z', "111001010100111" },
+            { ' ', "000000000000000" }, { ':', "000010000010000" }, { '-', "000000111000000" }, { '.', "000000000000010" },
+            { '!', "010010010000010" }, { '?', "111001010000010" }, { '/', "001001010100100" }, { '+', "000010111010000" },
+        };
+        PixelWidth = std::max(PixelWidth, 1);
+        PixelHeight = std::max(PixelHeight, 1);
+        Reset(5 * PixelHeight);
+        m_Spacing = PixelWidth;
+        const int width = 3 * PixelWidth;
+        std::vector<wchar_t> cells((size_t)width * m_Height);
+        for (const auto& glyph : glyphs)
+        {
+            for (int y = 0; y < m_Height; ++y)
+                for (int x = 0; x < width; ++x)
+                    cells[(size_t)y * width + x] = glyph.Bits[(y / PixelHeight) * 3 + x / PixelWidth] == '1' ? Character : 0;
+            AddGlyph((wchar_t)glyph.Code, width, cells.data());
+        }
+    }
+
+    ///<summary> Add or replace glyph of Width x Height() cells, character 0 is transparent </summary>
+    void AddGlyph(wchar_t Code, int Width, const wchar_t* Cells)
+    {
+        Glyph glyph;
+        glyph.Width = Width;
+        glyph.Offset = m_Cells.size();
+        glyph.FirstRun = m_Runs.size();
+        for (int y = 0; y < m_Height; ++y)
+        {
+            const wchar_t* row = Cells + (size_t)y * Width;
+            for (int x = 0; x < Width;)
+            {
+                if (!row[x])
+                {
+                    ++x;
+                    continue;
+                }
+                int end = x;
+                while (end < Width && row[end])
+                    ++end;
+                m_Runs.push_back({ y, x, end - x });
+                x = end;
+            }
+        }
+        glyph.RunCount = m_Runs.size() - glyph.FirstRun;
+        for (size_t i = 0; i < (size_t)Width * m_Height; ++i)
+            m_Cells.push_back(Cells[i]);
+        m_Glyphs[Code] = glyph;
+        ++m_Version;
+    }
+
+    /* Drawing */
+public:
+    // Width of Text in cells without trailing spacing
+    int Measure(const std::wstring& Text) const
+    {
+        int width = 0;
+        for (wchar_t c : Text)
+            if (const Glyph* glyph = Find(c))
+                width += glyph->Width + m_Spacing;
+        return std::max(width - m_Spacing, 0);
+    }
+
+    ///<summary> Draw Text with top left corner at (x,y) in Color, clipped by target clip rect </summary>
+    ///<remarks> Only visible runs of glyphs are written, cells between them keep what was drawn before </remarks>
+    void Draw(RenderTarget& Target, int x, int y, const std::wstring& Text, short Color) const
+    {
+        const ClipRect& clip = Target.Clip();
+        if (y >= clip.Bottom || y + m_Height <= clip.Top)
+            return;
+        for (wchar_t c : Text)
+        {
+            const Glyph* glyph = Find(c);
+            if (!glyph)
+                continue;
+            if (x >= clip.Right)
+                break;
+            if (x + glyph->Width > clip.Left)
+                DrawGlyph(Target, x, y, *glyph, Color);
+            x += glyph->Width + m_Spacing;
+        }
+    }
+
+private:
+    struct Glyph
+    {
+        int Width = 0;
+        size_t Offset = 0;                  // First cell in m_Cells, rows follow each other
+        size_t FirstRun = 0, RunCount = 0;
+    };
+    // Visible cells in one row of a glyph
+    struct Run
+    {
+        int y, x, Length;
+    };
+
+    void Reset(int Height)
+    {
+        m_Height = Height;
+        m_Spacing = 0;
+        m_Glyphs.clear();
+        m_Cells.clear();
+        m_Runs.clear();
+        ++m_Version;
+    }
+
+    // Lower case letters fall back to upper case ones, many block fonts have only those
+    const Glyph* Find(wchar_t Code) const
+    {
+        auto found = m_Glyphs.find(Code);
+        if (found == m_Glyphs.end() && Code >= L'a' && Code <= L'z')
+            found = m_Glyphs.find(Code - L'a' + L'A');
+        return found == m_Glyphs.end() ? nullptr : &found->second;
+    }
+
+    void DrawGlyph(RenderTarget& Target, int x, int y, const Glyph& Glyph, short Color) const
+    {
+        const ClipRect& clip = Target.Clip();
+        for (size_t i = Glyph.FirstRun; i < Glyph.FirstRun + Glyph.RunCount; ++i)
+        {
+            const Run& run = m_Runs[i];
+            const int ty = y + run.y;
+            if (ty < clip.Top || ty >= clip.Bottom)
+                continue;
+            const int x1 = std::max(x + run.x, clip.Left);
+            const int x2 = std::min(x + run.x + run.Length, clip.Right);
+            if (x1 >= x2)
+                continue;
+            const wchar_t* from = m_Cells.data() + Glyph.Offset + (size_t)run.y * Glyph.Width + (x1 - x);
+            Pixel* to = Target.Row(ty) + x1;
+            for (int i = 0; i < x2 - x1; ++i)
+            {
+                to[i].Char.UnicodeChar = from[i];
+                to[i].Attributes = Color;
+            }
+            Target.CountWrites(to, x2 - x1);
+        }
+    }
+
+    int m_Height = 0;
+    int m_Spacing = 0;
+    uint32_t m_Version = 0;
+    std::unordered_map<wchar_t, Glyph> m_Glyphs;
+    std::vector<wchar_t> m_Cells;       // Characters of all glyphs, zero is transparent
+    std::vector<Run> m_Runs;
+};
+
+/* Text of a big font rendered once and kept while text, color and font stay the same,
+   so e.g. a score that changes rarely costs only a keyed copy per frame */
+class BigText
+{
+public:
+    explicit BigText(const BigFont& Font) : m_Font(&Font) {}
+
+    void Draw(RenderTarget& Target, int x, int y, const std::wstring& Text, short Color)
+    {
+        if (Text != m_Text || Color != m_Color || m_Font->Version() != m_Version)
+            Render(Text, Color);
+        m_Cache.Composite(Target, x, y, 0);
+    }
+
+    int Width() const { return m_Cache.Width(); }
+    int Height() const { return m_Cache.Height(); }
+    // Count of renders, stays the same while cached picture is reused
+    size_t RenderCount() const { return m_RenderCount; }
+
+private:
+    void Render(const std::wstring& Text, short Color)
+    {
+        m_Text = Text;
+        m_Color = Color;
+        m_Version = m_Font->Version();
+        // Cells that glyphs don't cover keep character 0 and are skipped by the keyed copy
+        m_Cache.Resize(std::max(m_Font->Measure(Text), 1), std::max(m_Font->Height(), 1));
+        m_Font->Draw(m_Cache, 0, 0, Text, Color);
+        ++m_RenderCount;
+    }
+
+    const BigFont* m_Font;
+    RenderTarget m_Cache;
+    std::wstring m_Text;
+    short m_Color = 0;
+    uint32_t m_Version = 0;
+    size_t m_RenderCount = 0;
+};
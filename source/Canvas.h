@@ -0,0 +1,816 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+#include <stf/DrawKernels.h>
+#include <stf/FloodFill.h>
+#include <stf/FastRandom.h>
+#include <stf/DrawCommands.h>
+#include <stf/WorkerPool.h>
+
+// Point overloads take iVec2 of stf library, without it a plain pair of ints stands in, so this folder builds alone
+#if __has_include(<stf/Vector.h>)
+#include <stf/Vector.h>
+#else
+namespace stf
+{
+    struct iVec2
+    {
+        int x = 0, y = 0;
+    };
+}
+#endif
+
+#include <string>
+#include <memory>
+#include <stdlib.h>
+#include <stddef.h>
+
+// In this namespace defined a lot of cool (my own) usefull classes 
+using namespace stf;
+
+// Character color attributes
+enum COLOR : short
+{
+    FG_BLACK = 0x0000, BG_BLACK = 0x0000,
+    FG_DARK_BLUE = 0x0001, BG_DARK_BLUE = 0x0010,
+    FG_DARK_GREEN = 0x0002, BG_DARK_GREEN = 0x0020,
+    FG_DARK_CYAN = 0x0003, BG_DARK_CYAN = 0x0030,
+    FG_DARK_RED = 0x0004, BG_DARK_RED = 0x0040,
+    FG_DARK_MAGENTA = 0x0005, BG_DARK_MAGENTA = 0x0050,
+    FG_DARK_YELLOW = 0x0006, BG_DARK_YELLOW = 0x0060,
+    FG_GREY = 0x0007, BG_GREY = 0x0070,
+    FG_DARK_GREY = 0x0008, BG_DARK_GREY = 0x0080,
+    FG_BLUE = 0x0009, BG_BLUE = 0x0090,
+    FG_GREEN = 0x000A, BG_GREEN = 0x00A0,
+    FG_CYAN = 0x000B, BG_CYAN = 0x00B0,
+    FG_RED = 0x000C, BG_RED = 0x00C0,
+    FG_MAGENTA = 0x000D, BG_MAGENTA = 0x00D0,
+    FG_YELLOW = 0x000E, BG_YELLOW = 0x00E0,
+    FG_WHITE = 0x000F, BG_WHITE = 0x00F0
+};
+
+// UNICODE characters with filled quads
+enum QUAD : short
+{
+    SOLID = 0x2588,
+    THREEQUARTERS = 0x2593,
+    HALF = 0x2592,
+    QUARTER = 0x2591
+};
+
+// What part of the cell Draw* routines write
+enum class DRAW_MODE : short
+{
+    OVERWRITE = 0x0,    // Character and color
+    GLYPH,              // Only character
+    ATTRIBUTE,          // Only color
+    KEYED,              // Everything except cells with transparent key character
+    SHADE               // Shade glyph with drawn color over the color of the cell
+};
+
+/* Drawing routines over render target, buffer level only so it builds without Windows.h */
+class Canvas
+{
+public:
+    explicit Canvas(RenderTarget* Target = nullptr) : m_Target(Target), m_DefaultTarget(Target) {}
+
+protected:
+    // Target used when SetRenderTarget() gets nullptr
+    void SetDefaultTarget(RenderTarget* Target)
+    {
+        FlushDrawing();
+        if (m_Target == m_DefaultTarget)
+            m_Target = Target;
+        m_DefaultTarget = Target;
+    }
+
+public:
+    ///<summary> Select what part of the cell every Draw* routine writes </summary>
+    ///<remarks> Engine resets mode to DRAW_MODE::OVERWRITE after every Update() </remarks>
+    void SetDrawMode(DRAW_MODE Mode) { m_DrawMode = Mode; }
+    DRAW_MODE GetDrawMode() const { return m_DrawMode; }
+    // Character skipped by DRAW_MODE::KEYED
+    void SetTransparentKey(short Character = L' ') { m_TransparentKey = Character; }
+    // Glyph written by DRAW_MODE::SHADE
+    void SetShadeGlyph(short Character = QUAD::HALF) { m_ShadeGlyph = Character; }
+
+    void DrawPixel(int x, int y, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::PIXEL, Character, Color, x, y), y, y + 1);
+        WithKernel<ClipToRect>(Character, Color, [&](auto Kernel, const auto& Writer) { Kernel.Plot(*m_Target, x, y, Writer); });
+    }
+    void DrawPixel(iVec2 Point, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        DrawPixel(Point.x, Point.y, Character, Color);
+    }
+
+    void DrawPixelUnsafe(int x, int y, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::PIXEL_UNSAFE, Character, Color, x, y), y, y + 1);
+        WithKernel<ClipNone>(Character, Color, [&](auto Kernel, const auto& Writer) { Kernel.Plot(*m_Target, x, y, Writer); });
+    }
+    void DrawPixelUnsafe(iVec2 Point, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        DrawPixelUnsafe(Point.x, Point.y, Character, Color);
+    }
+
+    ///<summary> Draw batch of pixels with the same character and color </summary>
+    ///<remarks> Coordinates clipped four at a time with SIMD compares, then only visible written </remarks>
+    void DrawPixels(const int* X, const int* Y, size_t Count, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (m_Deferred)
+            return RecordPixels(X, Y, Count, nullptr, nullptr, Character, Color);
+        WithKernel<ClipNone>(Character, Color, [&](auto, const auto& Writer)
+        {
+            DrawPixelsBatch(X, Y, Count, [&Writer](size_t, Pixel& Target) { Writer.Plot(Target); });
+        });
+    }
+    ///<summary> Draw batch of pixels with per pixel characters and colors </summary>
+    void DrawPixels(const int* X, const int* Y, size_t Count, const short* Characters, const short* Colors)
+    {
+        if (m_Deferred)
+            return RecordPixels(X, Y, Count, Characters, Colors, 0, 0);
+        const short parameter = ModeParameter();
+        WithKernel<ClipNone>(0, 0, [&](auto, const auto& Writer)
+        {
+            using WriterType = typename std::decay<decltype(Writer)>::type;
+            DrawPixelsBatch(X, Y, Count, [&](size_t Index, Pixel& Target)
+            {
+                WriterType(MakePixel(Characters[Index], Colors[Index]), parameter).Plot(Target);
+            });
+        });
+    }
+
+private:
+    template < typename WriteFunc >
+    void DrawPixelsBatch(const int* X, const int* Y, size_t Count, WriteFunc Write)
+    {
+        const ClipRect clip = m_Target->Clip();
+        const int width = m_Target->Width();
+        Pixel* const buffer = m_Target->Data();
+        size_t i = 0;
+#ifdef CE_SIMD_SSE2
+        const __m128i left4 = _mm_set1_epi32(clip.Left - 1);
+        const __m128i top4 = _mm_set1_epi32(clip.Top - 1);
+        const __m128i right4 = _mm_set1_epi32(clip.Right);
+        const __m128i bottom4 = _mm_set1_epi32(clip.Bottom);
+        for (; i + 4 <= Count; i += 4)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(X + i));
+            __m128i y = _mm_loadu_si128((const __m128i*)(Y + i));
+            __m128i inside = _mm_and_si128(
+                _mm_and_si128(_mm_cmpgt_epi32(x, left4), _mm_cmplt_epi32(x, right4)),
+                _mm_and_si128(_mm_cmpgt_epi32(y, top4), _mm_cmplt_epi32(y, bottom4)));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(inside));
+            if (mask == 0)
+                continue;
+            for (int lane = 0; lane < 4; ++lane)
+                if (mask & (1 << lane))
+                {
+                    Pixel& cell = buffer[Y[i + lane] * width + X[i + lane]];
+                    Write(i + lane, cell);
+                    m_Target->CountWrites(&cell, 1);
+                }
+        }
+#endif
+        for (; i < Count; ++i)
+            if (clip.Contains(X[i], Y[i]))
+            {
+                Pixel& cell = buffer[Y[i] * width + X[i]];
+                Write(i, cell);
+                m_Target->CountWrites(&cell, 1);
+            }
+    }
+
+    static Pixel MakePixel(short Character, short Color)
+    {
+        Pixel pixel;
+        pixel.Char.UnicodeChar = Character;
+        pixel.Attributes = Color;
+        return pixel;
+    }
+
+    short ModeParameter() const { return m_DrawMode == DRAW_MODE::SHADE ? m_ShadeGlyph : m_TransparentKey; }
+
+    ///<summary> Call Draw(Kernel, Writer) with kernel compiled for the current draw mode </summary>
+    ///<remarks> Mode switch happens once per primitive, loops inside kernels have no branches on it </remarks>
+    template < typename Clip, typename DrawFunc >
+    void WithKernel(short Character, short Color, DrawFunc&& Draw)
+    {
+        const Pixel value = MakePixel(Character, Color);
+        const short parameter = ModeParameter();
+        switch (m_DrawMode)
+        {
+        case DRAW_MODE::OVERWRITE: Draw(DrawKernel<Clip, WriteOverwrite>(), WriteOverwrite(value, parameter)); break;
+        case DRAW_MODE::GLYPH: Draw(DrawKernel<Clip, WriteGlyph>(), WriteGlyph(value, parameter)); break;
+        case DRAW_MODE::ATTRIBUTE: Draw(DrawKernel<Clip, WriteAttribute>(), WriteAttribute(value, parameter)); break;
+        case DRAW_MODE::KEYED: Draw(DrawKernel<Clip, WriteKeyed>(), WriteKeyed(value, parameter)); break;
+        case DRAW_MODE::SHADE: Draw(DrawKernel<Clip, WriteShade>(), WriteShade(value, parameter)); break;
+        }
+    }
+
+    // Per cell clipping is skipped for primitives whose bounds are inside the clip rect
+    template < typename DrawFunc >
+    void WithBoundedKernel(int x1, int y1, int x2, int y2, short Character, short Color, DrawFunc&& Draw)
+    {
+        const ClipRect& clip = m_Target->Clip();
+        if (x1 >= clip.Left && y1 >= clip.Top && x2 < clip.Right && y2 < clip.Bottom)
+            WithKernel<ClipPreclipped>(Character, Color, Draw);
+        else
+            WithKernel<ClipToRect>(Character, Color, Draw);
+    }
+
+    DRAW_MODE m_DrawMode = DRAW_MODE::OVERWRITE;
+    short m_TransparentKey = L' ';
+    short m_ShadeGlyph = QUAD::HALF;
+    RenderTarget* m_Target = nullptr;
+    RenderTarget* m_DefaultTarget = nullptr;
+
+    std::vector<int> m_CircleSpans;     // Half widths of filled circle rows, reused between calls
+    FastRandom m_Random;
+    std::vector<uint32_t> m_NoiseBits;  // One row of noise, reused between calls
+    std::vector<int> m_NoiseGlyphs, m_NoiseColors;
+    FloodFiller m_FloodFiller;
+    CellMask m_FloodMask;
+
+public:
+
+    void DrawRect(int x1, int y1, int x2, int y2, short Character = 0x2588, short Color = FG_BLACK)
+    {
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::RECT, Character, Color, x1, y1, x2, y2), y1, y2);
+        WithKernel<ClipToRect>(Character, Color, [&](auto Kernel, const auto& Writer) { Kernel.Rect(*m_Target, x1, y1, x2, y2, Writer); });
+    }
+    void DrawRect(iVec2 TopLeft, iVec2 DownRight, short Character = 0x2588, short Color = FG_BLACK)
+    {
+        DrawRect(TopLeft.x, TopLeft.y, DownRight.x, DownRight.y, Character, Color);
+    }
+    void DrawBox(int pos_x, int pos_y, int size_x, int size_y, short Character = 0x2588, short Color = FG_BLACK)
+    {
+        DrawRect(pos_x, pos_y, pos_x + size_x, pos_y + size_y, Character, Color);
+    }
+    void DrawBox(iVec2 Position, iVec2 Size, short Character = 0x2588, short Color = FG_BLACK)
+    {
+        DrawBox(Position.x, Position.y, Size.x, Size.y, Character, Color);
+    }
+
+
+    ///<summary> Drawing multicolor string start with position (x,y) </summary>
+    ///<param name="string"> Use simbol '$' to pop next Color from ...  </param>
+    void DrawString(int x, int y, const std::wstring& string, short Color = FG_WHITE, ...)
+    {
+        ptrdiff_t addr_delta = 1;
+        short current_color = Color;
+        size_t index_offset = 0;
+        for (size_t i = 0; i < string.size(); ++i)
+        {
+            if (string[i] == L'$')
+            {
+                current_color = *(&Color + (addr_delta++) * sizeof(short));
+                ++i, ++index_offset;
+            }
+            DrawPixel(x + i - index_offset, y, string[i], current_color);
+        }
+    }
+    ///<summary> Drawing multicolor string start with position (x,y) </summary>
+    ///<param name="string"> Use simbol '$' to pop next Color from ...  </param>
+    template < typename ... ColorFormat>
+    void DrawString(iVec2 Position, const std::wstring& string, short Color = FG_WHITE, ColorFormat... format)
+    {
+        DrawString(Position.x, Position.y, string, Color, format...);
+    }
+
+    /* Impementation of Brezenhem algorithms for drawing */
+    void DrawCircle(int X, int Y, int R, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::CIRCLE, Character, Color, X, Y, R), Y - R, Y + R + 1);
+        WithBoundedKernel(X - R, Y - R, X + R, Y + R, Character, Color, [&](auto Kernel, const auto& Writer)
+        {
+            CircleKernel<decltype(Kernel)>(X, Y, R, Writer);
+        });
+    }
+    void DrawCircle(iVec2 Center, int R, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        DrawCircle(Center.x, Center.y, R, Character, Color);
+    }
+    void DrawFillCircle(int X, int Y, int R, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (R < 0)
+            return;
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::FILL_CIRCLE, Character, Color, X, Y, R), Y - R, Y + R + 1);
+        WithBoundedKernel(X - R, Y - R, X + R, Y + R, Character, Color, [&](auto Kernel, const auto& Writer)
+        {
+            FillCircleKernel<decltype(Kernel)>(X, Y, R, Writer);
+        });
+    }
+    void DrawLine(int x1, int y1, int x2, int y2, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        if (m_Deferred)
+            return Record(MakeCommand(DRAW_COMMAND::LINE, Character, Color, x1, y1, x2, y2), std::min(y1, y2), std::max(y1, y2) + 1);
+        WithBoundedKernel(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2), Character, Color, [&](auto Kernel, const auto& Writer)
+        {
+            LineKernel<decltype(Kernel)>(x1, y1, x2, y2, Writer);
+        });
+    }
+    void DrawLine(iVec2 First, iVec2 Second, short Character = 0x2588, short Color = FG_WHITE)
+    {
+        DrawLine(First.x, First.y, Second.x, Second.y, Character, Color);
+    }
+
+private:
+    template < typename Kernel, typename Writer >
+    void CircleKernel(int X, int Y, int R, const Writer& Write)
+    {
+        RenderTarget& target = *m_Target;
+        int x = R;
+        int y = 0;
+        int p = 1 - x;
+        while (x >= y)
+        {
+            Kernel::Plot(target, x + X, y + Y, Write); Kernel::Plot(target, x + X, -y + Y, Write);
+            Kernel::Plot(target, -y + X, x + Y, Write); Kernel::Plot(target, -y + X, -x + Y, Write);
+            Kernel::Plot(target, -x + X, -y + Y, Write); Kernel::Plot(target, -x + X, y + Y, Write);
+            Kernel::Plot(target, y + X, -x + Y, Write); Kernel::Plot(target, y + X, x + Y, Write);
+            ++y;
+            if (p < 0)
+            {
+                p += 2 * y + 1;
+            }
+            else
+            {
+                --x;
+                p += 2 * (y - x + 1);
+            }
+        }
+    }
+
+    // Same cells as vertical lines of the midpoint circle, but every row filled once as a span
+    template < typename Kernel, typename Writer >
+    void FillCircleKernel(int X, int Y, int R, const Writer& Write)
+    {
+        m_CircleSpans.assign(R + 1, -1);
+        int x = R;
+        int y = 0;
+        int p = 1 - x;
+        while (x >= y)
+        {
+            // Column x covers rows up to y and column y covers rows up to x
+            m_CircleSpans[y] = std::max(m_CircleSpans[y], x);
+            m_CircleSpans[x] = std::max(m_CircleSpans[x], y);
+            ++y;
+            if (p < 0)
+            {
+                p += 2 * y + 1;
+            }
+            else
+            {
+                --x;
+                p += 2 * (y - x + 1);
+            }
+        }
+
+        RenderTarget& target = *m_Target;
+        int half_width = -1;
+        for (int row = R; row >= 0; --row)
+        {
+            half_width = std::max(half_width, m_CircleSpans[row]);
+            if (half_width < 0)
+                continue;
+            Kernel::Fill(target, X - half_width, Y + row, 2 * half_width + 1, Write);
+            if (row != 0)
+                Kernel::Fill(target, X - half_width, Y - row, 2 * half_width + 1, Write);
+        }
+    }
+
+    template < typename Kernel, typename Writer >
+    void LineKernel(int x1, int y1, int x2, int y2, const Writer& Write)
+    {
+        RenderTarget& target = *m_Target;
+        int x, y, dx, dy, dx1, dy1, px, py, xe, ye, i;
+        dx = x2 - x1; dy = y2 - y1;
+        dx1 = abs(dx); dy1 = abs(dy);
+        px = 2 * dy1 - dx1;	py = 2 * dx1 - dy1;
+        if (dy1 <= dx1)
+        {
+            if (dx >= 0)
+            {
+                x = x1; y = y1; xe = x2;
+            }
+            else
+            {
+                x = x2; y = y2; xe = x1;
+            }
+
+            Kernel::Plot(target, x, y, Write);
+
+            for (i = 0; x < xe; i++)
+            {
+                x = x + 1;
+                if (px < 0)
+                    px = px + 2 * dy1;
+                else
+                {
+                    if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) y = y + 1; else y = y - 1;
+                    px = px + 2 * (dy1 - dx1);
+                }
+                Kernel::Plot(target, x, y, Write);
+            }
+        }
+        else
+        {
+            if (dy >= 0)
+            {
+                x = x1; y = y1; ye = y2;
+            }
+            else
+            {
+                x = x2; y = y2; ye = y1;
+            }
+
+            Kernel::Plot(target, x, y, Write);
+
+            for (i = 0; y < ye; i++)
+            {
+                y = y + 1;
+                if (py <= 0)
+                    py = py + 2 * dx1;
+                else
+                {
+                    if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) x = x + 1; else x = x - 1;
+                    py = py + 2 * (dx1 - dy1);
+                }
+                Kernel::Plot(target, x, y, Write);
+            }
+        }
+    }
+
+public:
+    // Copy a row of pixels to the target starting from (x,y), clipped by its clip rect
+    void DrawSpan(int x, int y, const Pixel* Span, int Length)
+    {
+        if (m_Deferred)
+            return RecordSpan(x, y, Span, Length);
+        WithKernel<ClipToRect>(0, 0, [&](auto Kernel, const auto& Writer) { Kernel.Copy(*m_Target, x, y, Span, Length, Writer); });
+    }
+    void DrawSpan(iVec2 Position, const Pixel* Span, int Length)
+    {
+        DrawSpan(Position.x, Position.y, Span, Length);
+    }
+
+    void DrawScreenBuffer(int pos_x, int pos_y, int size_x, int size_y, const Pixel* Buffer)
+    {
+        // Copy row by row, so every row clipped once instead of every pixel
+        for (int y = 0; y < size_y; ++y)
+            DrawSpan(pos_x, pos_y + y, Buffer + y * size_x, size_x);
+    }
+    void DrawScreenBuffer(iVec2 Position, iVec2 Size, const Pixel* Buffer)
+    {
+        DrawScreenBuffer(Position.x, Position.y, Size.x, Size.y, Buffer);
+    }
+
+    // Copy other target to the current one, KeyCharacter cells are skipped when Transparent
+    void DrawRenderTarget(int x, int y, const RenderTarget& Source, bool Transparent = false, short KeyCharacter = L' ')
+    {
+        if (m_Deferred)
+        {
+            DrawCommand command = MakeCommand(Transparent ? DRAW_COMMAND::COMPOSITE : DRAW_COMMAND::BLIT, KeyCharacter, 0, x, y);
+            command.Source = &Source;
+            return Record(command, y, y + Source.Height());
+        }
+        if (Transparent)
+            Source.Composite(*m_Target, x, y, KeyCharacter);
+        else
+            Source.Blit(*m_Target, x, y);
+    }
+    void DrawRenderTarget(iVec2 Position, const RenderTarget& Source, bool Transparent = false, short KeyCharacter = L' ')
+    {
+        DrawRenderTarget(Position.x, Position.y, Source, Transparent, KeyCharacter);
+    }
+
+    ///<summary> Fill region of the current target 4-connected to (x,y) with cells like the seed one </summary>
+    ///<param name="Match"> Cells must have the same character, color or both to be filled </param>
+    ///<returns> Count of filled cells </returns>
+    size_t DrawFloodFill(int x, int y, short Character = 0x2588, short Color = FG_WHITE, FILL_MATCH Match = FILL_MATCH::BOTH)
+    {
+        FlushDrawing();
+        size_t count = m_FloodFiller.Select(*m_Target, x, y, Match, m_FloodMask);
+        WithKernel<ClipNone>(Character, Color, [&](auto Kernel, const auto& Writer)
+        {
+            m_FloodMask.ForEachSpan([&](int SpanX, int SpanY, int Length) { Kernel.Fill(*m_Target, SpanX, SpanY, Length, Writer); });
+        });
+        return count;
+    }
+    size_t DrawFloodFill(iVec2 Seed, short Character = 0x2588, short Color = FG_WHITE, FILL_MATCH Match = FILL_MATCH::BOTH)
+    {
+        return DrawFloodFill(Seed.x, Seed.y, Character, Color, Match);
+    }
+    // Same region as DrawFloodFill() as a mask, without drawing
+    size_t SelectRegion(int x, int y, FILL_MATCH Match, CellMask& Out)
+    {
+        FlushDrawing();
+        return m_FloodFiller.Select(*m_Target, x, y, Match, Out);
+    }
+
+    /* Noise */
+public:
+    ///<summary> Fill [x1,x2) x [y1,y2) with Character of random colors, color is random bits under ColorMask </summary>
+    ///<remarks> Cells are written directly ignoring draw mode, so full screen of noise costs about as much as a clear </remarks>
+    void FillRandom(int x1, int y1, int x2, int y2, short Character, short ColorMask = 0x00FF)
+    {
+        FlushDrawing();
+        if (!ClipRegion(x1, y1, x2, y2))
+            return;
+        const int width = x2 - x1;
+        m_NoiseBits.resize(width);
+        const uint32_t mask = (uint32_t)(uint16_t)ColorMask << 16;
+        const uint32_t glyph = (uint16_t)Character;
+        for (int y = y1; y < y2; ++y)
+        {
+            m_Random.FillU32(m_NoiseBits.data(), width);
+            Pixel* row = m_Target->Row(y) + x1;
+            int x = 0;
+#ifdef CE_SIMD_SSE2
+            // Pixel is character in low and attributes in high half of 32 bits
+            const __m128i wide_mask = _mm_set1_epi32((int)mask);
+            const __m128i wide_glyph = _mm_set1_epi32((int)glyph);
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i bits = _mm_loadu_si128((const __m128i*)(m_NoiseBits.data() + x));
+                _mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_and_si128(bits, wide_mask), wide_glyph));
+            }
+#endif
+            for (; x < width; ++x)
+            {
+                row[x].Char.UnicodeChar = Character;
+                row[x].Attributes = (short)((m_NoiseBits[x] & mask) >> 16);
+            }
+            m_Target->CountWrites(row, width);
+        }
+    }
+    void FillRandom(iVec2 TopLeft, iVec2 DownRight, short Character, short ColorMask = 0x00FF)
+    {
+        FillRandom(TopLeft.x, TopLeft.y, DownRight.x, DownRight.y, Character, ColorMask);
+    }
+
+    ///<summary> Fill [x1,x2) x [y1,y2) with random entries of Glyphs and Colors, chosen without bias </summary>
+    ///<param name="Glyphs"> nullptr or zero count keeps characters of cells, the same for Colors </param>
+    void FillRandom(int x1, int y1, int x2, int y2, const short* Glyphs, int GlyphCount, const short* Colors, int ColorCount)
+    {
+        FlushDrawing();
+        if (!ClipRegion(x1, y1, x2, y2))
+            return;
+        const int width = x2 - x1;
+        const bool glyphs = Glyphs && GlyphCount > 0;
+        const bool colors = Colors && ColorCount > 0;
+        m_NoiseGlyphs.resize(width);
+        m_NoiseColors.resize(width);
+        for (int y = y1; y < y2; ++y)
+        {
+            Pixel* row = m_Target->Row(y) + x1;
+            if (glyphs)
+            {
+                m_Random.FillRange(m_NoiseGlyphs.data(), width, 0, GlyphCount);
+                for (int x = 0; x < width; ++x)
+                    row[x].Char.UnicodeChar = Glyphs[m_NoiseGlyphs[x]];
+            }
+            if (colors)
+            {
+                m_Random.FillRange(m_NoiseColors.data(), width, 0, ColorCount);
+                for (int x = 0; x < width; ++x)
+                    row[x].Attributes = Colors[m_NoiseColors[x]];
+            }
+            m_Target->CountWrites(row, width);
+        }
+    }
+
+    // Generator behind FillRandom(), free to use for other effects
+    FastRandom& GetRandom() { return m_Random; }
+    void SetRandomSeed(uint64_t Seed) { m_Random.SetSeed(Seed); }
+
+private:
+    // Clip [x1,x2) x [y1,y2) by the clip rect, false when nothing is left
+    bool ClipRegion(int& x1, int& y1, int& x2, int& y2) const
+    {
+        const ClipRect& clip = m_Target->Clip();
+        x1 = std::max(x1, clip.Left);
+        y1 = std::max(y1, clip.Top);
+        x2 = std::min(x2, clip.Right);
+        y2 = std::min(y2, clip.Bottom);
+        return x1 < x2 && y1 < y2;
+    }
+
+public:
+    ///<summary> Redirect all Draw* calls to Target, nullptr returns them to the default target </summary>
+    ///<remarks> Engine resets target to the screen after every Update() </remarks>
+    void SetRenderTarget(RenderTarget* Target)
+    {
+        RenderTarget* target = Target ? Target : m_DefaultTarget;
+        if (target != m_Target)
+            FlushDrawing();
+        m_Target = target;
+    }
+    // Recorded calls are drawn first, since caller may draw to the target directly
+    RenderTarget& GetRenderTarget()
+    {
+        FlushDrawing();
+        return *m_Target;
+    }
+
+    /* Deferred drawing */
+public:
+    ///<summary> Record Draw* calls instead of drawing, FlushDrawing() draws them on worker threads </summary>
+    ///<remarks> Target is split in bands of CE_DEFERRED_BAND_ROWS rows. A thread draws one band with commands
+    ///          that touch it in the order of calls, so the picture is the same as of immediate drawing.
+    ///          Sources of DrawRenderTarget() are read at flush, they must not change before it and must not be the target.
+    ///          FillRandom(), flood fill, GetRenderTarget() and switch to other target flush first,
+    ///          other direct access to the target needs FlushDrawing(). Engine flushes before every present </remarks>
+    void SetDeferredDrawing(bool Deferred)
+    {
+        if (!Deferred)
+            FlushDrawing();
+        m_Deferred = Deferred;
+    }
+    bool IsDeferredDrawing() const { return m_Deferred; }
+    // Share pool with other users, nullptr makes canvas create its own on the first parallel flush
+    void SetWorkerPool(WorkerPool* Pool) { m_Pool = Pool; }
+    size_t PendingDrawCommands() const { return m_Commands.Size(); }
+
+    ///<summary> Draw recorded calls to the current target, one band per job </summary>
+    ///<remarks> Threads write disjoint rows through own views of the target, so write paths don't lock </remarks>
+    void FlushDrawing()
+    {
+        if (m_Commands.Empty())
+            return;
+        const size_t bands = m_Commands.Bands();
+        while (m_BandPainters.size() < bands)
+        {
+            m_BandViews.emplace_back(new RenderTarget);
+            m_BandPainters.emplace_back(new Canvas(m_BandViews.back().get()));
+        }
+        if (bands > 1 && !m_Pool)
+        {
+            if (!m_OwnPool)
+                m_OwnPool.reset(new WorkerPool);
+            m_Pool = m_OwnPool.get();
+        }
+
+        if (bands > 1)
+            m_Pool->ParallelFor(bands, [this](size_t Band) { DrawBand(Band); });
+        else
+            DrawBand(0);
+        m_Commands.Reset(m_Commands.Height());
+    }
+
+private:
+    void DrawBand(size_t Band)
+    {
+        RenderTarget& view = *m_BandViews[Band];
+        Canvas& painter = *m_BandPainters[Band];
+        view.AttachView(*m_Target);
+        const int top = m_Commands.BandTop(Band), bottom = m_Commands.BandBottom(Band);
+        for (uint32_t index : m_Commands.Bin(Band))
+        {
+            const DrawCommand& command = m_Commands[index];
+            view.SetClip(command.Clip.Left, std::max(command.Clip.Top, top), command.Clip.Right, std::min(command.Clip.Bottom, bottom));
+            painter.m_DrawMode = (DRAW_MODE)command.Mode;
+            painter.m_TransparentKey = painter.m_ShadeGlyph = command.Parameter;
+            painter.Execute(command, m_Commands);
+        }
+    }
+
+    // Command of the current state, the first command of a frame bins list by the current target
+    DrawCommand MakeCommand(DRAW_COMMAND Type, short Character, short Color, int x1 = 0, int y1 = 0, int x2 = 0, int y2 = 0)
+    {
+        if (m_Commands.Empty())
+            m_Commands.Reset(m_Target->Height());
+        DrawCommand command;
+        command.Type = Type;
+        command.Mode = (short)m_DrawMode;
+        command.Parameter = ModeParameter();
+        command.Character = Character;
+        command.Color = Color;
+        command.x1 = x1, command.y1 = y1, command.x2 = x2, command.y2 = y2;
+        command.Payload = command.Count = 0;
+        command.Source = nullptr;
+        command.Clip = m_Target->Clip();
+        return command;
+    }
+
+    // Add command that writes only rows [Top, Bottom), rows out of clip are dropped
+    void Record(const DrawCommand& Command, int Top, int Bottom)
+    {
+        if (Command.Type != DRAW_COMMAND::PIXEL_UNSAFE)
+        {
+            Top = std::max(Top, Command.Clip.Top);
+            Bottom = std::min(Bottom, Command.Clip.Bottom);
+        }
+        m_Commands.Add(Command, Top, Bottom);
+    }
+
+    // Only visible part of the span is copied, writers work per cell so the result is the same
+    void RecordSpan(int x, int y, const Pixel* Span, int Length)
+    {
+        DrawCommand command = MakeCommand(DRAW_COMMAND::SPAN, 0, 0);
+        const ClipRect& clip = command.Clip;
+        const int x1 = std::max(x, clip.Left), x2 = std::min(x + Length, clip.Right);
+        if (x1 >= x2 || y < clip.Top || y >= clip.Bottom)
+            return;
+        command.x1 = x1;
+        command.y1 = y;
+        command.Payload = m_Commands.AddPixels(Span + (x1 - x), x2 - x1);
+        command.Count = x2 - x1;
+        Record(command, y, y + 1);
+    }
+
+    // Visible pixels of the batch are sorted by bands and every band gets a command with its own, so no band walks the whole batch
+    void RecordPixels(const int* X, const int* Y, size_t Count, const short* Characters, const short* Colors, short Character, short Color)
+    {
+        DrawCommand command = MakeCommand(Characters ? DRAW_COMMAND::PIXELS_COLORED : DRAW_COMMAND::PIXELS, Character, Color);
+        const ClipRect& clip = command.Clip;
+        const size_t bands = m_Commands.Bands();
+        m_BandBatches.assign(bands, BandBatch{});
+        for (size_t i = 0; i < Count; ++i)
+            if (clip.Contains(X[i], Y[i]))
+                ++m_BandBatches[Y[i] / CE_DEFERRED_BAND_ROWS].Count;
+
+        for (size_t band = 0; band < bands; ++band)
+        {
+            BandBatch& batch = m_BandBatches[band];
+            if (!batch.Count)
+                continue;
+            batch.Coordinates = m_Commands.AllocateCoordinates(2 * (size_t)batch.Count);
+            if (Characters)
+                batch.Attributes = m_Commands.AllocateAttributes(2 * (size_t)batch.Count);
+            command.Payload = batch.Coordinates;
+            command.Count = batch.Count;
+            command.x1 = (int)batch.Attributes;
+            m_Commands.Add(command, m_Commands.BandTop(band), m_Commands.BandBottom(band));
+        }
+        // X then Y of every band, characters then colors for batches with them
+        for (size_t i = 0; i < Count; ++i)
+        {
+            if (!clip.Contains(X[i], Y[i]))
+                continue;
+            BandBatch& batch = m_BandBatches[Y[i] / CE_DEFERRED_BAND_ROWS];
+            int* coordinates = m_Commands.Coordinates(batch.Coordinates);
+            coordinates[batch.Filled] = X[i];
+            coordinates[batch.Count + batch.Filled] = Y[i];
+            if (Characters)
+            {
+                short* attributes = m_Commands.Attributes(batch.Attributes);
+                attributes[batch.Filled] = Characters[i];
+                attributes[batch.Count + batch.Filled] = Colors[i];
+            }
+            ++batch.Filled;
+        }
+    }
+
+    // Draw command to the current target right away
+    void Execute(const DrawCommand& Command, const DrawCommandList& List)
+    {
+        switch (Command.Type)
+        {
+        case DRAW_COMMAND::PIXEL: DrawPixel(Command.x1, Command.y1, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::PIXEL_UNSAFE: DrawPixelUnsafe(Command.x1, Command.y1, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::RECT: DrawRect(Command.x1, Command.y1, Command.x2, Command.y2, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::LINE: DrawLine(Command.x1, Command.y1, Command.x2, Command.y2, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::CIRCLE: DrawCircle(Command.x1, Command.y1, Command.x2, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::FILL_CIRCLE: DrawFillCircle(Command.x1, Command.y1, Command.x2, Command.Character, Command.Color); break;
+        case DRAW_COMMAND::SPAN: DrawSpan(Command.x1, Command.y1, List.Pixels(Command.Payload), (int)Command.Count); break;
+        case DRAW_COMMAND::PIXELS:
+        {
+            const int* coordinates = List.Coordinates(Command.Payload);
+            DrawPixels(coordinates, coordinates + Command.Count, Command.Count, Command.Character, Command.Color);
+            break;
+        }
+        case DRAW_COMMAND::PIXELS_COLORED:
+        {
+            const int* coordinates = List.Coordinates(Command.Payload);
+            const short* attributes = List.Attributes((uint32_t)Command.x1);
+            DrawPixels(coordinates, coordinates + Command.Count, Command.Count, attributes, attributes + Command.Count);
+            break;
+        }
+        case DRAW_COMMAND::BLIT: Command.Source->Blit(*m_Target, Command.x1, Command.y1); break;
+        case DRAW_COMMAND::COMPOSITE: Command.Source->Composite(*m_Target, Command.x1, Command.y1, Command.Character); break;
+        }
+    }
+
+    struct BandBatch
+    {
+        uint32_t Count = 0, Filled = 0;
+        uint32_t Coordinates = 0, Attributes = 0;
+    };
+
+    bool m_Deferred = false;
+    DrawCommandList m_Commands;
+    std::vector<BandBatch> m_BandBatches;
+    // Every band draws through own view and canvas, so bands share no mutable state
+    std::vector<std::unique_ptr<RenderTarget>> m_BandViews;
+    std::vector<std::unique_ptr<Canvas>> m_BandPainters;
+    WorkerPool* m_Pool = nullptr;
+    std::unique_ptr<WorkerPool> m_OwnPool;
+};
@@ -15,11 +15,19 @@ Character Set -> Use Unicode.
 #include <chrono>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <future>
+#include <algorithm>
 
 #include <stf/Containers.h>
 #include <stf/Random.h>
 #include <stf/Vector.h>
 #include <stf/Matrix.h>
+#include <stf/Entities.h>
+#include <stf/FrameArena.h>
+#include <stf/Canvas.h>
+#include <stf/Overdraw.h>
+#include <stf/ResolutionScaler.h>
 
 #define PI 3.141592653589793
 #define TWO_PI 6.283185307179586
@@ -37,6 +45,13 @@ Character Set -> Use Unicode.
 #define CE_DEFAULT_FPS_LIM 60.0
 #define CE_MOUSE_MAX_BUTTONS 5
 #define CE_AVERAGE_FRAMELIST_SIZE 10
+#define CE_KEY_BUFFER_RESERVE 256
+#define CE_INPUT_BATCH 64           // Console events read at once, the queue is drained in several reads
+#define CE_IDLE_MAX_WAIT 1000ms     // Longest sleep of idle mode, so timers and title still refresh
+
+// #define CE_DEBUG_ALLOCATIONS // Uncomment this to count operator new calls per frame
+// Define CE_DEBUG_ALLOCATIONS_IMPLEMENTATION in one .cpp before the include, it gets the counting operator new
+#define CE_ALLOCATIONS_WARMUP_FRAMES 10
 
 // In case this is wheel roll up and down event
 #define CE_MOUSE_ADDITIONAL_EVENTS 2
@@ -47,36 +62,6 @@ using namespace stf;
 // Using time literals
 using namespace std::chrono_literals;
 
-// Character color attributes
-enum COLOR : short
-{
-    FG_BLACK = 0x0000, BG_BLACK = 0x0000,
-    FG_DARK_BLUE = 0x0001, BG_DARK_BLUE = 0x0010,
-    FG_DARK_GREEN = 0x0002, BG_DARK_GREEN = 0x0020,
-    FG_DARK_CYAN = 0x0003, BG_DARK_CYAN = 0x0030,
-    FG_DARK_RED = 0x0004, BG_DARK_RED = 0x0040,
-    FG_DARK_MAGENTA = 0x0005, BG_DARK_MAGENTA = 0x0050,
-    FG_DARK_YELLOW = 0x0006, BG_DARK_YELLOW = 0x0060,
-    FG_GREY = 0x0007, BG_GREY = 0x0070,
-    FG_DARK_GREY = 0x0008, BG_DARK_GREY = 0x0080,
-    FG_BLUE = 0x0009, BG_BLUE = 0x0090,
-    FG_GREEN = 0x000A, BG_GREEN = 0x00A0,
-    FG_CYAN = 0x000B, BG_CYAN = 0x00B0,
-    FG_RED = 0x000C, BG_RED = 0x00C0,
-    FG_MAGENTA = 0x000D, BG_MAGENTA = 0x00D0,
-    FG_YELLOW = 0x000E, BG_YELLOW = 0x00E0,
-    FG_WHITE = 0x000F, BG_WHITE = 0x00F0
-};
-
-// UNICODE characters with filled quads
-enum QUAD : short
-{
-    SOLID = 0x2588,
-    THREEQUARTERS = 0x2593,
-    HALF = 0x2592,
-    QUARTER = 0x2591
-};
-
 // UNICODE characters for draw command-line shapes
 enum BOXSHAPE : short
 {
@@ -161,11 +146,33 @@ struct KeyInfo
     KeyState State;
 };
 
-// Screen buffer pixel data
-typedef CHAR_INFO Pixel;
+// Entity components that engine draws after systems update
+struct CellPosition
+{
+    int x = 0;
+    int y = 0;
+};
+
+struct Glyph
+{
+    short Character = 0x2588;
+    short Color = FG_WHITE;
+};
+
+// Image with top left corner at CellPosition, cells array is not owned
+struct Sprite
+{
+    const Pixel* Cells = nullptr;
+    int Width = 0;
+    int Height = 0;
+};
+
+#ifdef CE_DEBUG_ALLOCATIONS
+inline std::atomic<size_t> CE_AllocationCount{ 0 };
+#endif
 
 /* You must publicly inheritated from this */
-class ConsoleEngine abstract
+class ConsoleEngine abstract : public Canvas
 {
 public:
     ConsoleEngine()
@@ -179,12 +186,40 @@ public:
         hConsoleOutput = GetStdHandle(STD_OUTPUT_HANDLE);
 
         hCursor = GetCursor();
+
+        // Hook pushes keys from another thread, so buffer must not grow in the middle of the frame
+        m_KeyBuffer.reserve(CE_KEY_BUFFER_RESERVE);
+
+        SetDefaultTarget(&m_ScreenTarget);
+
+        // Auto reset event that wakes idle update loop
+        m_WakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+        std::lock_guard<std::mutex> lock(InstancesMutex());
+        Instances().push_back(this);
     }
 
 private:
     bool m_IsConsoleFullscreen = false;
+    bool m_IsHeadless = false;
 
 public:
+    ///<summary> Construct engine without console, only screen buffer is allocated </summary>
+    ///<remarks> Headless engine don't read input and don't present frames, so many of them can run
+    /// in parallel threads of one process, e.g. for batch rendering, bots and tests </remarks>
+    BOOL ConstructHeadless(int screen_width, int screen_height)
+    {
+        m_IsHeadless = true;
+
+        m_MouseX = screen_width / 2;
+        m_MouseY = screen_height / 2;
+
+        ResizeScreenBuffer(screen_width, screen_height);
+        return 1;
+    }
+
+    bool IsHeadless() const { return m_IsHeadless; }
+
     BOOL ConstructConsole(int screen_width, int screen_height, int font_width, int font_height)
     {
         m_Screen.x = screen_width;
@@ -250,11 +285,11 @@ public:
             return Error(L"Invalid SetConsoleCursorInfo");
 
         // Allocate memory for screen buffer
-        m_ScreenBuffer = new CHAR_INFO[m_Screen.x*m_Screen.y];
-        memset(m_ScreenBuffer, 0, sizeof(CHAR_INFO) * m_Screen.x * m_Screen.y);
+        ResizeScreenBuffer(m_Screen.x, m_Screen.y);
 
-        // Handler for Close Envent
-        SetConsoleCtrlHandler((PHANDLER_ROUTINE)CloseEvent, TRUE);
+        // Handler for Close Envent, one for all instances
+        static std::once_flag CloseHandlerFlag;
+        std::call_once(CloseHandlerFlag, [] { SetConsoleCtrlHandler((PHANDLER_ROUTINE)CloseEvent, TRUE); });
         return 1;
     }
 
@@ -336,261 +371,63 @@ public:
             return Error(L"Invalid SetConsoleCursorInfo");
 
         // Allocate memory for screen buffer
-        m_ScreenBuffer = new CHAR_INFO[m_Screen.x*m_Screen.y];
-        memset(m_ScreenBuffer, 0, sizeof(CHAR_INFO) * m_Screen.x * m_Screen.y);
+        ResizeScreenBuffer(m_Screen.x, m_Screen.y);
 
-        // Handler for Close Envent
-        SetConsoleCtrlHandler((PHANDLER_ROUTINE)CloseEvent, TRUE);
+        // Handler for Close Envent, one for all instances
+        static std::once_flag CloseHandlerFlag;
+        std::call_once(CloseHandlerFlag, [] { SetConsoleCtrlHandler((PHANDLER_ROUTINE)CloseEvent, TRUE); });
         return 1;
     }
 
-    /* Drawing routine */
-public:
-    void DrawPixel(int x, int y, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        if (x >= 0 && x < (int)m_Screen.x && y >= 0 && y < (int)m_Screen.y)
-        {
-            m_ScreenBuffer[y * m_Screen.x + x].Char.UnicodeChar = Character;
-            m_ScreenBuffer[y * m_Screen.x + x].Attributes = Color;
-        }
-    }
-    void DrawPixel(iVec2 Point, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        DrawPixel(Point.x, Point.y, Character, Color);
-    }
-
-    void DrawPixelUnsafe(int x, int y, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        m_ScreenBuffer[y * m_Screen.x + x].Char.UnicodeChar = Character;
-        m_ScreenBuffer[y * m_Screen.x + x].Attributes = Color;
-    }
-    void DrawPixelUnsafe(iVec2 Point, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        DrawPixelUnsafe(Point.x, Point.y, Character, Color);
-    }
-
-    void DrawRect(int x1, int y1, int x2, int y2, short Character = 0x2588, short Color = FG_BLACK)
-    {
-        // Clamp values
-        if (x1 < 0) x1 = 0;
-        if (y1 < 0) y1 = 0;
-        if (x2 > ScreenWidth()) x2 = ScreenWidth();
-        if (y2 > ScreenHeight()) y2 = ScreenHeight();
-
-        for (int x = x1; x < x2; x++)
-            for (int y = y1; y < y2; y++)
-            {
-                m_ScreenBuffer[y * m_Screen.x + x].Char.UnicodeChar = Character;
-                m_ScreenBuffer[y * m_Screen.x + x].Attributes = Color;
-            }
-    }
-    void DrawRect(iVec2 TopLeft, iVec2 DownRight, short Character = 0x2588, short Color = FG_BLACK)
-    {
-        DrawRect(TopLeft.x, TopLeft.y, DownRight.x, DownRight.y, Character, Color);
-    }
-    void DrawBox(int pos_x, int pos_y, int size_x, int size_y, short Character = 0x2588, short Color = FG_BLACK)
-    {
-        // Clamp values
-        if (pos_x < 0) pos_x = 0;
-        if (pos_y < 0) pos_y = 0;
-        if (size_x + pos_x > ScreenWidth()) size_x = ScreenWidth() - pos_x;
-        if (size_y + pos_y > ScreenHeight()) size_y = ScreenHeight() - pos_y;
-
-        for (int x = 0; x < size_x; x++)
-            for (int y = 0; y < size_y; y++)
-            {
-                m_ScreenBuffer[(y + pos_y) * m_Screen.x + x + pos_x].Char.UnicodeChar = Character;
-                m_ScreenBuffer[(y + pos_y) * m_Screen.x + x + pos_x].Attributes = Color;
-            }
-    }
-    void DrawBox(iVec2 Position, iVec2 Size, short Character = 0x2588, short Color = FG_BLACK)
-    {
-        DrawBox(Position.x, Position.y, Size.x, Size.y, Character, Color);
-    }
-
-
-    ///<summary> Drawing multicolor string start with position (x,y) </summary>
-    ///<param name="string"> Use simbol '$' to pop next Color from ...  </param>
-    void DrawString(int x, int y, const std::wstring& string, short Color = FG_WHITE, ...)
-    {
-        ptrdiff_t addr_delta = 1;
-        short current_color = Color;
-        size_t index_offset = 0;
-        for (size_t i = 0; i < string.size(); ++i)
-        {
-            if (string[i] == L'$')
-            {
-                current_color = *(&Color + (addr_delta++) * sizeof(short));
-                ++i, ++index_offset;
-            }
-            DrawPixel(x + i - index_offset, y, string[i], current_color);
-        }
-    }
-    ///<summary> Drawing multicolor string start with position (x,y) </summary>
-    ///<param name="string"> Use simbol '$' to pop next Color from ...  </param>
-    template < typename ... ColorFormat>
-    void DrawString(iVec2 Position, const std::wstring& string, short Color = FG_WHITE, ColorFormat... format)
-    {
-        DrawString(Position.x, Position.y, string, Color, format...);
-    }
-
-    /* Impementation of Brezenhem algorithms for drawing */
-    void DrawCircle(int X, int Y, int R, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        int x = R;
-        int y = 0;
-        int p = 1 - x;
-        while (x >= y)
-        {
-            DrawPixel(x + X, y + Y, Character, Color); DrawPixel(x + X, -y + Y, Character, Color);
-            DrawPixel(-y + X, x + Y, Character, Color); DrawPixel(-y + X, -x + Y, Character, Color);
-            DrawPixel(-x + X, -y + Y, Character, Color); DrawPixel(-x + X, y + Y, Character, Color);
-            DrawPixel(y + X, -x + Y, Character, Color); DrawPixel(y + X, x + Y, Character, Color);
-            ++y;
-            if (p < 0)
-            {
-                p += 2 * y + 1;
-            }
-            else
-            {
-                --x;
-                p += 2 * (y - x + 1);
-            }
-        }
-    }
-    void DrawCircle(iVec2 Center, int R, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        DrawCircle(Center.x, Center.y, R, Character, Color);
-    }
-    void DrawFillCircle(int X, int Y, int R, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        int x = R;
-        int y = 0;
-        int p = 1 - x;
-        while (x >= y)
-        {
-            DrawLine(x + X, y + Y, x + X, -y + Y, Character, Color);
-            DrawLine(-y + X, x + Y, -y + X, -x + Y, Character, Color);
-            DrawLine(-x + X, -y + Y, -x + X, y + Y, Character, Color);
-            DrawLine(y + X, -x + Y, y + X, x + Y, Character, Color);
-            ++y;
-            if (p < 0)
-            {
-                p += 2 * y + 1;
-            }
-            else
-            {
-                --x;
-                p += 2 * (y - x + 1);
-            }
-        }
-    }
-    void DrawLine(int x1, int y1, int x2, int y2, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        int x, y, dx, dy, dx1, dy1, px, py, xe, ye, i;
-        dx = x2 - x1; dy = y2 - y1;
-        dx1 = abs(dx); dy1 = abs(dy);
-        px = 2 * dy1 - dx1;	py = 2 * dx1 - dy1;
-        if (dy1 <= dx1)
-        {
-            if (dx >= 0)
-            {
-                x = x1; y = y1; xe = x2;
-            }
-            else
-            {
-                x = x2; y = y2; xe = x1;
-            }
-
-            DrawPixel(x, y, Character, Color);
-
-            for (i = 0; x < xe; i++)
-            {
-                x = x + 1;
-                if (px < 0)
-                    px = px + 2 * dy1;
-                else
-                {
-                    if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) y = y + 1; else y = y - 1;
-                    px = px + 2 * (dy1 - dx1);
-                }
-                DrawPixel(x, y, Character, Color);
-            }
-        }
-        else
-        {
-            if (dy >= 0)
-            {
-                x = x1; y = y1; ye = y2;
-            }
-            else
-            {
-                x = x2; y = y2; ye = y1;
-            }
-
-            DrawPixel(x, y, Character, Color);
-
-            for (i = 0; y < ye; i++)
-            {
-                y = y + 1;
-                if (py <= 0)
-                    py = py + 2 * dx1;
-                else
-                {
-                    if ((dx < 0 && dy < 0) || (dx > 0 && dy > 0)) x = x + 1; else x = x - 1;
-                    py = py + 2 * (dx1 - dy1);
-                }
-                DrawPixel(x, y, Character, Color);
-            }
-        }
-    }
-    void DrawLine(iVec2 First, iVec2 Second, short Character = 0x2588, short Color = FG_WHITE)
-    {
-        DrawLine(First.x, First.y, Second.x, Second.y, Character, Color);
-    }
-
-    void DrawScreenBuffer(int pos_x, int pos_y, int size_x, int size_y, const Pixel* Buffer)
-    {
-        for (int x = pos_x; x < pos_x + size_x; ++x)
-            for (int y = pos_y; x < pos_y + size_y; ++y)
-                DrawPixel(x, y,
-                    Buffer[(y - pos_y)*size_x + (pos_x - x)].Char.UnicodeChar,
-                    Buffer[(y - pos_y)*size_x + (pos_x - x)].Attributes
-                );
-    }
-    void DrawScreenBuffer(iVec2 Position, iVec2 Size, const Pixel* Buffer)
+    // Screen as a target, its clip rect limits drawing to the part of the screen
+    RenderTarget& GetScreenTarget()
     {
-        DrawScreenBuffer(Position.x, Position.y, Size.x, Size.y, Buffer);
+        FlushDrawing();
+        return m_ScreenTarget;
     }
 
-    // Return screen buffer for direct lookup
-    const Pixel* const GetScreenBuffer() const
+    // Return screen buffer for direct lookup, recorded calls are drawn first
+    const Pixel* const GetScreenBuffer()
     {
+        FlushDrawing();
         return m_ScreenBuffer;
     }
 
     std::wstring GetString(int x, int y, int Lenght)
     {
+        FlushDrawing();
         std::wstring result;
-        if (x + Lenght >= 0 && x + Lenght < (int)m_Screen.x && y >= 0 && y < (int)m_Screen.y)
+        const RenderTarget& frame = FrameTarget();
+        if (x + Lenght >= 0 && x + Lenght < frame.Width() && y >= 0 && y < frame.Height())
         {
             result.reserve(Lenght);
             for (int i = 0; i < Lenght; ++i)
-                result += m_ScreenBuffer[y * m_Screen.x + x + i].Char.UnicodeChar;
+                result += frame.Row(y)[x + i].Char.UnicodeChar;
             return result;
         }
         return result;
     }
-    std::wstring GetString(iVec2 Position, int Lenght) { GetString(Position.x, Position.y, Lenght); }
+    std::wstring GetString(iVec2 Position, int Lenght) { return GetString(Position.x, Position.y, Lenght); }
+
+    ///<summary> Copy characters of the row into Out without allocations </summary>
+    ///<param name="Out"> Buffer for Length + 1 characters, e.g. from GetFrameArena() </param>
+    ///<returns> Count of copied characters, the rest of the row out of screen is skipped </returns>
+    int GetString(int x, int y, int Length, wchar_t* Out)
+    {
+        FlushDrawing();
+        int count = 0;
+        const RenderTarget& frame = FrameTarget();
+        if (y >= 0 && y < frame.Height())
+            for (int i = std::max(x, 0); i < x + Length && i < frame.Width(); ++i)
+                Out[count++] = frame.Row(y)[i].Char.UnicodeChar;
+        Out[count] = L'\0';
+        return count;
+    }
 
     Pixel GetPixel(int x, int y)
     {
-        if (x >= 0 && x < (int)m_Screen.x && y >= 0 && y < (int)m_Screen.y)
-        {
-            return m_ScreenBuffer[y * m_Screen.x + x];
-        }
-        else
-            return {};
+        FlushDrawing();
+        return FrameTarget().Get(x, y);
     }
     Pixel GetPixel(iVec2 Point) { return GetPixel(Point.x, Point.y); }
 
@@ -601,26 +438,47 @@ protected:
 
     /* Not necessary to override */
     virtual void Destroy() { Quit(); }     // Proc once on exit from Update()
+    virtual void OnResize(int Width, int Height) {}    // Proc before Update() when screen size changed, buffer is cleared
+    virtual void OnPresent(const Pixel* Buffer, int Width, int Height) {}   // Proc with final frame right before it's written to console
 
-    ~ConsoleEngine() = default;
+    ~ConsoleEngine()
+    {
+        {
+            // Close handler may still wait for this instance, it must not be freed under it
+            std::unique_lock<std::mutex> lock(InstancesMutex());
+            InstancesCondition().wait(lock, [this] { return m_CloseWaiters == 0; });
+            Instances().erase(std::find(Instances().begin(), Instances().end(), this));
+        }
+        CloseHandle(m_WakeEvent);
+        delete[] m_ScreenBuffer;
+    }
 
     /* Screen info */
 private:
     iVec2 m_Screen;
+    iVec2 m_Frame;                      // Size of picture Update() draws, less than screen with dynamic resolution
     SMALL_RECT rectWindow;
+    size_t m_ScreenCapacity = 0;        // Allocated cells of m_ScreenBuffer, may be more than screen
+    RenderTarget m_ScreenTarget;        // View of m_ScreenBuffer, default target of drawing without dynamic resolution
 
     iVec2 m_FontSize;
 
 public:
+    // Size of picture that Update() draws, scaled down with dynamic resolution
     constexpr const int ScreenWidth() const
     {
-        return m_Screen.x;
+        return m_Frame.x;
     }
     constexpr const int ScreenHeight() const
     {
-        return m_Screen.y;
+        return m_Frame.y;
     }
     const iVec2 Screen() const
+    {
+        return m_Frame;
+    }
+    // Size of the console in cells, always the full resolution
+    const iVec2 ConsoleSize() const
     {
         return m_Screen;
     }
@@ -704,9 +562,7 @@ public:
             return Error(L"Invalid SetConsoleMode");
 
         // Reallocate memory for screen buffer
-        delete[] m_ScreenBuffer;
-        m_ScreenBuffer = new CHAR_INFO[m_Screen.x*m_Screen.y];
-        memset(m_ScreenBuffer, 0, sizeof(CHAR_INFO) * m_Screen.x * m_Screen.y);
+        ResizeScreenBuffer(m_Screen.x, m_Screen.y);
 
         // Disable cursore
         CONSOLE_CURSOR_INFO cursor;
@@ -715,9 +571,50 @@ public:
         if (!SetConsoleCursorInfo(hConsoleOutput, &cursor))
             return Error(L"Invalid SetConsoleCursorInfo");
 
+        m_PresentedFrame.clear();
+        OnResize(m_Frame.x, m_Frame.y);
         return 1;
     }
 
+private:
+    // Fit buffer to width x height and clear it, memory grows geometrically and never shrinks
+    void ResizeScreenBuffer(int width, int height)
+    {
+        // Recorded calls point into the old buffer
+        FlushDrawing();
+        size_t required = (size_t)width * height;
+        if (required > m_ScreenCapacity)
+        {
+            size_t capacity = std::max(required, m_ScreenCapacity * 2);
+            delete[] m_ScreenBuffer;
+            m_ScreenBuffer = new CHAR_INFO[capacity];
+            m_ScreenCapacity = capacity;
+        }
+        m_Screen.x = width;
+        m_Screen.y = height;
+        memset(m_ScreenBuffer, 0, sizeof(CHAR_INFO) * required);
+        m_ScreenTarget.Attach(m_ScreenBuffer, width, height);
+        m_PresentedFrame.clear();
+        ApplyResolution();
+    }
+
+    // Console buffer was resized by user, adopt its size without touching display mode
+    void HandleResize(int width, int height)
+    {
+        if (width <= 0 || height <= 0 || (width == m_Screen.x && height == m_Screen.y))
+            return;
+
+        ResizeScreenBuffer(width, height);
+        rectWindow = { 0, 0, (short)(width - 1), (short)(height - 1) };
+
+        if (m_MouseX >= width) m_MouseX = width - 1;
+        if (m_MouseY >= height) m_MouseY = height - 1;
+
+        OnResize(m_Frame.x, m_Frame.y);
+    }
+
+public:
+
     /* Input */
 private:
     KeyState m_Keys[256], m_Mouse[CE_MOUSE_MAX_BUTTONS + CE_MOUSE_ADDITIONAL_EVENTS];
@@ -725,15 +622,20 @@ private:
 
     int m_MouseX;
     int m_MouseY;
+    int m_MouseWheel = 0;               // Sum of wheel deltas of the frame
+    DWORD m_MouseButtons = 0;           // Button bits of the last mouse event
+
+    INPUT_RECORD m_InputBatch[CE_INPUT_BATCH];  // Reused for every read of console events
 
 public:
-    constexpr const int& GetMouseX() const
+    // Mouse is in cells of the picture Update() draws, so it follows dynamic resolution
+    int GetMouseX() const
     {
-        return m_MouseX;
+        return m_Frame.x == m_Screen.x ? m_MouseX : m_MouseX * m_Frame.x / m_Screen.x;
     }
-    constexpr const int& GetMouseY() const
+    int GetMouseY() const
     {
-        return m_MouseY;
+        return m_Frame.y == m_Screen.y ? m_MouseY : m_MouseY * m_Frame.y / m_Screen.y;
     }
     constexpr const KeyState& GetMouseButton(BUTTON mouse_button) const
     {
@@ -741,7 +643,12 @@ public:
     }
     iVec2 GetMouse() const
     {
-        return iVec2{ m_MouseX, m_MouseY };
+        return iVec2{ GetMouseX(), GetMouseY() };
+    }
+    // Wheel rolled during the last frame, WHEEL_DELTA (120) per notch and positive is forward
+    int GetMouseWheel() const
+    {
+        return m_MouseWheel;
     }
 
     void SetMouseCursor(CURSOR cursor_type)
@@ -781,9 +688,9 @@ public:
     }
 
     // Get every keys that proc
-    static const List<KeyInfo>& GetInputBuffer()
+    const std::vector<KeyInfo>& GetInputBuffer() const
     {
-        return CE_KeyBuffer;
+        return m_KeyBuffer;
     }
 
     // Check if console is focused window
@@ -817,15 +724,106 @@ public:
         }
     }
 
+    /* Entities */
+private:
+    // Glyph of the batch, Order is its submission index, so the latest one in a cell stays on top
+    struct BatchedGlyph
+    {
+        int Cell;
+        int Order;
+        Pixel Value;
+    };
+
+    World m_World;
+    std::vector<BatchedGlyph> m_GlyphBatch;             // Reused between frames to avoid allocations
+    std::vector<Pixel> m_GlyphSpan;
+
+public:
+    // Entities storage, systems registered here run after every Update()
+    World& GetWorld() { return m_World; }
+
+private:
+    // Render system: sprites row by row, then glyphs sorted by cell and merged into spans
+    void DrawEntities()
+    {
+        m_World.EachArray<CellPosition, Sprite>([this](size_t Count, const Entity*, const CellPosition* Positions, const Sprite* Sprites)
+        {
+            for (size_t i = 0; i < Count; ++i)
+                for (int y = 0; y < Sprites[i].Height; ++y)
+                    DrawSpan(Positions[i].x, Positions[i].y + y, Sprites[i].Cells + y * Sprites[i].Width, Sprites[i].Width);
+        });
+
+        RenderTarget& frame = FrameTarget();
+        m_GlyphBatch.clear();
+        m_World.EachArray<CellPosition, Glyph>([&frame, this](size_t Count, const Entity*, const CellPosition* Positions, const Glyph* Glyphs)
+        {
+            for (size_t i = 0; i < Count; ++i)
+            {
+                const CellPosition& pos = Positions[i];
+                if (pos.x < 0 || pos.x >= frame.Width() || pos.y < 0 || pos.y >= frame.Height())
+                    continue;
+                Pixel pixel;
+                pixel.Char.UnicodeChar = Glyphs[i].Character;
+                pixel.Attributes = Glyphs[i].Color;
+                m_GlyphBatch.push_back({ pos.y * frame.Width() + pos.x, (int)m_GlyphBatch.size(), pixel });
+            }
+        });
+        if (m_GlyphBatch.empty())
+            return;
+        // Sprites recorded by deferred drawing go under glyphs that are copied directly
+        FlushDrawing();
+
+        // Sorted in place by cell then order, std::stable_sort would allocate a buffer every frame
+        std::sort(m_GlyphBatch.begin(), m_GlyphBatch.end(),
+            [](const BatchedGlyph& a, const BatchedGlyph& b) { return a.Cell != b.Cell ? a.Cell < b.Cell : a.Order < b.Order; });
+
+        // Collect runs of neighbour cells in a row and copy every run with one memcpy
+        size_t i = 0;
+        while (i < m_GlyphBatch.size())
+        {
+            const int start = m_GlyphBatch[i].Cell;
+            const int row_end = (start / frame.Width() + 1) * frame.Width();
+            m_GlyphSpan.clear();
+            m_GlyphSpan.push_back(m_GlyphBatch[i].Value);
+            for (++i; i < m_GlyphBatch.size(); ++i)
+            {
+                const int next = m_GlyphBatch[i].Cell;
+                const int last = start + (int)m_GlyphSpan.size() - 1;
+                if (next == last)
+                    m_GlyphSpan.back() = m_GlyphBatch[i].Value;
+                else if (next == last + 1 && next < row_end)
+                    m_GlyphSpan.push_back(m_GlyphBatch[i].Value);
+                else
+                    break;
+            }
+            memcpy(frame.Data() + start, m_GlyphSpan.data(), sizeof(Pixel) * m_GlyphSpan.size());
+            frame.CountWrites(frame.Data() + start, (int)m_GlyphSpan.size());
+        }
+    }
+
     /* Handle every keyboard inputs between frames */
 private:
-    static HHOOK CE_Hook;               // Just a hook to to callback keyboard function
-    static KeyInfo CE_LastKUI;          // Info about last key that proc
-    static List<KeyInfo> CE_KeyBuffer;  // Keys buffer, contains keys that change his states between frames
+    KeyInfo m_LastKUI;                  // Info about last key that proc
+    std::vector<KeyInfo> m_KeyBuffer;   // Keys buffer, contains keys that change his states between frames
+    std::atomic<DWORD> m_InputThreadId{ 0 };
+
+    // Low level hook is called on the thread that set it, so the thread knows its engine
+    static ConsoleEngine*& HookOwner()
+    {
+        thread_local ConsoleEngine* Owner = nullptr;
+        return Owner;
+    }
 
     static LRESULT CALLBACK KeyboardProc(_In_ int nCode, _In_ WPARAM wParam, _In_ LPARAM lParam)
     {
-        PKBDLLHOOKSTRUCT KBD = (PKBDLLHOOKSTRUCT)lParam;
+        ConsoleEngine* Owner = HookOwner();
+        if (nCode >= 0 && Owner)
+            Owner->BufferKey(wParam, (PKBDLLHOOKSTRUCT)lParam);
+        return CallNextHookEx(NULL, nCode, wParam, lParam);
+    }
+
+    void BufferKey(WPARAM wParam, PKBDLLHOOKSTRUCT KBD)
+    {
         KeyInfo KI;
         KI.Code = KBD->vkCode;
         if ((KBD->flags & LLKHF_EXTENDED) != 0) { // Check if it's the enter on the numpad
@@ -833,7 +831,7 @@ private:
         }
         if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
         {
-            if (CE_LastKUI.Code == KI.Code && !CE_LastKUI.State.Released)
+            if (m_LastKUI.Code == KI.Code && !m_LastKUI.State.Released)
             {
                 KI.State.Pressed = false;
                 KI.State.Held = true;
@@ -847,121 +845,165 @@ private:
         {
             KI.State.Released = true;
         }
-        CE_MutexInputModifying.lock();
-        CE_KeyBuffer.push_back(KI);
-        CE_LastKUI = KI;
-        CE_MutexInputModifying.unlock();
-        return CallNextHookEx(CE_Hook, nCode, wParam, lParam);
+        m_MutexInputModifying.lock();
+        m_KeyBuffer.push_back(KI);
+        m_LastKUI = KI;
+        m_MutexInputModifying.unlock();
+        RequestRedraw();
     }
 
     /* Threads & utilities */
 private:
+    // Key and mouse state is built from console events, nothing is polled
     void ManuallyKeysUpdate()
     {
-        // If keys on lookup, then wait
-        // Handle Keyboard Input
-        for (size_t key_i = 0; key_i < 256; ++key_i)
+        // Pressed and Released last one frame, Held stays until the release event
+        for (KeyState& key : m_Keys)
+            key.Pressed = key.Released = false;
+        for (KeyState& button : m_Mouse)
+            button.Pressed = button.Released = false;
+        m_MouseWheel = 0;
+
+        COORD newSize = { 0, 0 };
+        COORD mousePosition = { 0, 0 };
+        bool mouseMoved = false;
+
+        // Drain events queued by now in batches of the reused buffer, later ones wait for the next frame
+        DWORD pending = 0;
+        GetNumberOfConsoleInputEvents(hConsoleInput, &pending);
+        while (pending > 0)
         {
-            keysNewState[key_i] = GetAsyncKeyState(key_i);
-            m_Keys[key_i].Pressed = false;
-            m_Keys[key_i].Released = false;
-            if (keysNewState[key_i] != keysOldState[key_i])
+            DWORD events = 0;
+            if (!ReadConsoleInput(hConsoleInput, m_InputBatch, std::min<DWORD>(pending, CE_INPUT_BATCH), &events) || events == 0)
+                break;
+            pending -= std::min(pending, events);
+
+            for (DWORD i = 0; i < events; i++)
             {
-                m_last_key = (KEY)key_i;
-                if (keysNewState[key_i] & 0x8000)
+                const INPUT_RECORD& record = m_InputBatch[i];
+                switch (record.EventType)
                 {
-                    m_Keys[key_i].Pressed = !m_Keys[key_i].Held;
-                    m_Keys[key_i].Held = true;
-                }
-                else
+                case KEY_EVENT:
+                    KeyEvent(record.Event.KeyEvent);
+                    break;
+
+                case MOUSE_EVENT:
                 {
-                    m_Keys[key_i].Released = true;
-                    m_Keys[key_i].Held = false;
+                    const MOUSE_EVENT_RECORD& mouse = record.Event.MouseEvent;
+                    if (mouse.dwEventFlags == MOUSE_WHEELED)
+                    {
+                        m_MouseWheel += (short)(mouse.dwButtonState >> 16);
+                        break;
+                    }
+                    // Moves only keep the latest position, so a fast drag is one update per frame
+                    mousePosition = mouse.dwMousePosition;
+                    mouseMoved = true;
+                    if ((mouse.dwButtonState & 0xFFFF) != m_MouseButtons)
+                        MouseButtonsEvent(mouse.dwButtonState & 0xFFFF);
                 }
-            }
-            keysOldState[key_i] = keysNewState[key_i];
-        }
-
-        // Check for window events
-        INPUT_RECORD inBuffer[32];
-        DWORD events = 0;
-        GetNumberOfConsoleInputEvents(hConsoleInput, &events);
-        if (events > 0)
-            ReadConsoleInput(hConsoleInput, inBuffer, events, &events);
-
-        for (DWORD i = 0; i < events; i++)
-        {
-            switch (inBuffer[i].EventType)
-            {
-            case FOCUS_EVENT:
-            {
-                ConsoleInFocus = inBuffer[i].Event.FocusEvent.bSetFocus;
-            }
-            break;
+                break;
 
-            case MOUSE_EVENT:
-            {
-                switch (inBuffer[i].Event.MouseEvent.dwEventFlags)
+                case FOCUS_EVENT:
                 {
-                case MOUSE_MOVED:
-                {
-                    m_MouseX = inBuffer[i].Event.MouseEvent.dwMousePosition.X;
-                    m_MouseY = inBuffer[i].Event.MouseEvent.dwMousePosition.Y;
+                    ConsoleInFocus = record.Event.FocusEvent.bSetFocus;
+                    // Release events go to other window, so nothing stays held after focus is lost
+                    if (!ConsoleInFocus)
+                        ReleaseAllKeys();
                 }
                 break;
 
-
-                case MOUSE_WHEELED:
+                case WINDOW_BUFFER_SIZE_EVENT:
                 {
-                    if ((short)(inBuffer[i].Event.MouseEvent.dwButtonState >> 16) > 0)
-                        mouseNewState[(size_t)BUTTON::WH_FORWARD] = true;
-                    else
-                        mouseNewState[(size_t)BUTTON::WH_BACKWARD] = true;
+                    // Only the last one matters when dragging produces a burst of them
+                    newSize = record.Event.WindowBufferSizeEvent.dwSize;
                 }
+                break;
 
                 default:
                     break;
                 }
-            case 0:
-            {
-                for (int m = 0; m < CE_MOUSE_MAX_BUTTONS; m++)
-                    mouseNewState[m] = (inBuffer[i].Event.MouseEvent.dwButtonState & (1 << m)) > 0;
             }
-            break;
+        }
 
-            }
-            break;
+        if (mouseMoved)
+        {
+            m_MouseX = mousePosition.X;
+            m_MouseY = mousePosition.Y;
+        }
 
-            default:
-                break;
-                // don't care just at the moment
-            }
+        // Wheel buttons are held while wheel rolls in their direction
+        SetKeyState(m_Mouse[(size_t)BUTTON::WH_FORWARD], m_MouseWheel > 0);
+        SetKeyState(m_Mouse[(size_t)BUTTON::WH_BACKWARD], m_MouseWheel < 0);
+
+        if (newSize.X > 0 && newSize.Y > 0)
+            HandleResize(newSize.X, newSize.Y);
+    }
+
+    // Returns true if state changed, Pressed and Released are kept when key goes both ways in one frame
+    static bool SetKeyState(KeyState& Key, bool Down)
+    {
+        if (Key.Held == Down)
+            return false;
+        Key.Held = Down;
+        if (Down)
+            Key.Pressed = true;
+        else
+            Key.Released = true;
+        return true;
+    }
+
+    void KeyEvent(const KEY_EVENT_RECORD& Event)
+    {
+        const WORD code = Event.wVirtualKeyCode;
+        if (code >= 256)
+            return;
+        const bool down = Event.bKeyDown != FALSE;
+
+        // Console reports generic modifiers, side is known from scan code or enhanced key flag
+        WORD side = 0;
+        switch (code)
+        {
+        case VK_SHIFT: side = Event.wVirtualScanCode == 0x36 ? VK_RSHIFT : VK_LSHIFT; break;
+        case VK_CONTROL: side = (Event.dwControlKeyState & ENHANCED_KEY) ? VK_RCONTROL : VK_LCONTROL; break;
+        case VK_MENU: side = (Event.dwControlKeyState & ENHANCED_KEY) ? VK_RMENU : VK_LMENU; break;
+        default: break;
         }
 
-        // Handle Mouse Input
-        for (int mouse_i = 0; mouse_i < CE_MOUSE_MAX_BUTTONS + CE_MOUSE_ADDITIONAL_EVENTS; mouse_i++)
+        bool changed;
+        if (side)
         {
-            m_Mouse[mouse_i].Pressed = false;
-            m_Mouse[mouse_i].Released = false;
-            if (mouseNewState[mouse_i] != mouseOldState[mouse_i])
-            {
-                if (mouseNewState[mouse_i])
-                {
-                    m_Mouse[mouse_i].Pressed = true;
-                    m_Mouse[mouse_i].Held = true;
-                }
-                else
-                {
-                    m_Mouse[mouse_i].Released = true;
-                    m_Mouse[mouse_i].Held = false;
-                }
-            }
-            mouseOldState[mouse_i] = mouseNewState[mouse_i];
+            // Generic modifier is held while any of its sides is, left codes are even
+            const WORD left = side & ~1;
+            changed = SetKeyState(m_Keys[side], down);
+            SetKeyState(m_Keys[code], m_Keys[left].Held || m_Keys[left + 1].Held);
+        }
+        else
+            changed = SetKeyState(m_Keys[code], down);
+
+        if (changed)
+            m_last_key = (KEY)(side ? side : code);
+    }
+
+    void MouseButtonsEvent(DWORD Buttons)
+    {
+        // Virtual key codes of console button bits, so GetKey() sees mouse buttons too
+        static const WORD ButtonKeys[CE_MOUSE_MAX_BUTTONS] = { VK_LBUTTON, VK_RBUTTON, VK_MBUTTON, VK_XBUTTON1, VK_XBUTTON2 };
+        for (int m = 0; m < CE_MOUSE_MAX_BUTTONS; m++)
+        {
+            const bool down = (Buttons & (1 << m)) != 0;
+            SetKeyState(m_Mouse[m], down);
+            SetKeyState(m_Keys[ButtonKeys[m]], down);
         }
+        m_MouseButtons = Buttons;
+    }
 
-        // Reset Mouse Wheel proc
-        mouseNewState[(size_t)BUTTON::WH_FORWARD] = false;
-        mouseNewState[(size_t)BUTTON::WH_BACKWARD] = false;
+    void ReleaseAllKeys()
+    {
+        for (KeyState& key : m_Keys)
+            SetKeyState(key, false);
+        for (int m = 0; m < CE_MOUSE_MAX_BUTTONS; m++)
+            SetKeyState(m_Mouse[m], false);
+        m_MouseButtons = 0;
     }
 
     void StableUpdateThread()
@@ -982,29 +1024,90 @@ private:
         size_t t_index{ 0 };
 
         // This cycle for the Destroy() return 1
-        while (CE_ActiveMainThread) {
-            while (CE_ActiveMainThread)
+        while (m_ActiveMainThread) {
+            while (m_ActiveMainThread)
             {
+                // Nothing to do until input, redraw request or timer
+                if (m_IdleMode)
+                {
+                    WaitForWork();
+                    if (!m_ActiveMainThread)
+                        break;
+                }
+
+#ifdef CE_DEBUG_ALLOCATIONS
+                size_t allocationsBefore = CE_AllocationCount;
+#endif
                 // Handle input
-                ManuallyKeysUpdate();
+                if (!m_IsHeadless)
+                    ManuallyKeysUpdate();
 
-                CE_MutexInputModifying.lock();
+                auto tpWorkBegin = std::chrono::high_resolution_clock::now();
+                m_MutexInputModifying.lock();
                 // Update game states
                 Update();
 
                 // Clear between frame keys update
-                CE_KeyBuffer.clear();
-                CE_MutexInputModifying.unlock();
+                m_KeyBuffer.clear();
+                m_MutexInputModifying.unlock();
+                SetRenderTarget(nullptr);
+                SetDrawMode(DRAW_MODE::OVERWRITE);
+
+                // Update and draw entities
+                m_World.RunSystems(m_StableDeltaTime);
+                DrawEntities();
+                // Bands of deferred drawing finish on workers before the frame is measured and presented
+                FlushDrawing();
+
+#ifdef CE_OVERDRAW
+                // Heatmap replaces the picture only while presenting, the frame is restored after
+                m_OverdrawStats = OverdrawOverlay::Measure(FrameTarget());
+                if (m_OverdrawOverlay)
+                {
+                    m_OverdrawBackup.assign(FrameTarget().Data(), FrameTarget().Data() + (size_t)m_Frame.x * m_Frame.y);
+                    OverdrawOverlay::Draw(FrameTarget(), m_OverdrawStats);
+                }
+                FrameTarget().ResetWriteCounts();
+#endif
+
+                if (m_DynamicResolution)
+                    m_Scaler.Upscale(m_ScaledTarget, m_ScreenTarget);
+                m_FrameWorkTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tpWorkBegin).count();
 
-                // Draw console characters
-                wchar_t TitleBuffer[256];
+                // Idle frames that drew the same picture are not presented again
+                m_FramePresented = !m_IdleMode || FrameChanged();
+                if (m_FramePresented)
+                {
+                    OnPresent(m_ScreenBuffer, m_Screen.x, m_Screen.y);
+
+                    // Draw console characters, title is slow to set so only when its text changed
+                    wchar_t TitleBuffer[256];
 #ifndef CE_NO_FPS_LIMIT
-                swprintf_s(TitleBuffer, 256, L"%s - FPS: %4.0f", m_AppName.c_str(), m_AverageFPS);
+                    swprintf_s(TitleBuffer, 256, L"%s - FPS: %4.0f", m_AppName.c_str(), m_AverageFPS);
 #else
-                swprintf_s(TitleBuffer, 256, L"%s", m_AppName.c_str());
+                    swprintf_s(TitleBuffer, 256, L"%s", m_AppName.c_str());
+#endif
+                    if (!m_IsHeadless)
+                    {
+                        if (wcscmp(TitleBuffer, m_LastTitle) != 0)
+                        {
+                            SetConsoleTitle(TitleBuffer);
+                            wcscpy_s(m_LastTitle, TitleBuffer);
+                        }
+                        WriteConsoleOutput(hConsoleOutput, m_ScreenBuffer, { (short)m_Screen.x, (short)m_Screen.y }, { 0,0 }, &rectWindow);
+                    }
+                }
+#ifdef CE_OVERDRAW
+                if (m_OverdrawOverlay)
+                    memcpy(FrameTarget().Data(), m_OverdrawBackup.data(), sizeof(Pixel) * m_OverdrawBackup.size());
 #endif
-                SetConsoleTitle(TitleBuffer);
-                WriteConsoleOutput(hConsoleOutput, m_ScreenBuffer, { (short)m_Screen.x, (short)m_Screen.y }, { 0,0 }, &rectWindow);
+
+                // New resolution takes effect from the next Update(), its picture starts cleared
+                if (m_DynamicResolution && m_Scaler.AddFrame(m_FrameWorkTime))
+                {
+                    ApplyResolution();
+                    OnResize(m_Frame.x, m_Frame.y);
+                }
 
                 auto tpCurrentTime = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now());
 
@@ -1037,44 +1140,85 @@ private:
                     m_AverageFPS += T;
                 m_AverageFPS = 1.0 / (m_AverageFPS / CE_AVERAGE_FRAMELIST_SIZE);
 #endif
+
+                // Everything allocated from arena during the frame is released at once
+                m_FrameArena.Reset();
+
+#ifdef CE_DEBUG_ALLOCATIONS
+                // Warm up frames fill caches and reserve buffers, after them frame must not allocate
+                m_FrameAllocations = CE_AllocationCount - allocationsBefore;
+                if (++m_FrameIndex > CE_ALLOCATIONS_WARMUP_FRAMES && m_FrameAllocations > 0)
+                {
+                    wchar_t Message[128];
+                    swprintf_s(Message, 128, L"Console Engine: frame %zu made %zu allocations\n", m_FrameIndex, m_FrameAllocations);
+                    OutputDebugStringW(Message);
+                }
+#endif
             }
 
             // Allow the user to free resources if they have overrided the destroy function
             Destroy();
 
-            // Exit and clean up
-            delete[] m_ScreenBuffer;
-            SetConsoleActiveScreenBuffer(hOriginalConsole);
-            CE_FinishedCondition.notify_one();
+            // Exit and clean up, screen buffer stays alive until destructor, so result can be read after Start()
+            if (!m_IsHeadless)
+                SetConsoleActiveScreenBuffer(hOriginalConsole);
+            {
+                std::lock_guard<std::mutex> lock(m_MutexFC);
+                m_Finished = true;
+            }
+            m_FinishedCondition.notify_all();
             return;
         }
     }
 
-    void BufferedInputThread()
+    // Hook lives only on this thread, it's removed here after Start() posts WM_QUIT
+    void BufferedInputThread(std::promise<bool>* Installed)
     {
-        CE_Hook = SetWindowsHookEx(WH_KEYBOARD_LL, KeyboardProc, NULL, NULL); // Set the keyboard hook
-        if (!CE_Hook)
-            return;
+        HookOwner() = this;
         MSG ThreadMsg;
-        while (GetMessage(&ThreadMsg, NULL, WM_KEYFIRST, WM_KEYLAST)) {} // Proc message queue update
+        // Create message queue before Start() learns the thread id, so WM_QUIT can't be lost
+        PeekMessage(&ThreadMsg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+        m_InputThreadId = GetCurrentThreadId();
+        HHOOK Hook = SetWindowsHookEx(WH_KEYBOARD_LL, KeyboardProc, NULL, NULL); // Set the keyboard hook
+        Installed->set_value(Hook != NULL);
+        if (!Hook)
+            return;
+        while (GetMessage(&ThreadMsg, NULL, WM_KEYFIRST, WM_KEYLAST) > 0) {} // Proc message queue update
+        UnhookWindowsHookEx(Hook);
+        HookOwner() = nullptr;
     }
 
 public:
     void Start()
     {
         tpStartProgram = std::chrono::system_clock::now();
-        CE_ActiveMainThread = true;
-        std::thread KeysInputThread(&ConsoleEngine::BufferedInputThread, this);
-        KeysInputThread.detach();
+        m_ActiveMainThread = true;
+        m_Finished = false;
+        std::thread KeysInputThread;
+        if (!m_IsHeadless)
+        {
+            // Update starts after the hook is installed, so quit from Init() still finds the input thread ready to stop
+            std::promise<bool> Installed;
+            std::future<bool> HookReady = Installed.get_future();
+            KeysInputThread = std::thread(&ConsoleEngine::BufferedInputThread, this, &Installed);
+            HookReady.wait();
+        }
         std::thread UpdateThread(&ConsoleEngine::StableUpdateThread, this);
         UpdateThread.join();
-        UnhookWindowsHookEx(CE_Hook);
+        if (KeysInputThread.joinable())
+        {
+            // WM_QUIT passes any GetMessage filter, so the input thread leaves its loop and unhooks
+            PostThreadMessage(m_InputThreadId, WM_QUIT, 0, 0);
+            KeysInputThread.join();
+            m_InputThreadId = 0;
+        }
     }
 
     // Force to exit from outside Update() function
     void Quit()
     {
-        CE_ActiveMainThread = false;
+        m_ActiveMainThread = false;
+        SetEvent(m_WakeEvent);
     }
 
     void SetAppName(const wchar_t* AppName)
@@ -1090,6 +1234,187 @@ public:
         return m_AverageFPS;
     }
 
+    /* Dynamic resolution */
+private:
+    ResolutionScaler m_Scaler;
+    RenderTarget m_ScaledTarget;        // Default target of drawing while dynamic resolution is on
+    bool m_DynamicResolution = false;
+    double m_FrameWorkTime = 0.0;
+
+    RenderTarget& FrameTarget() { return m_DynamicResolution ? m_ScaledTarget : m_ScreenTarget; }
+    const RenderTarget& FrameTarget() const { return m_DynamicResolution ? m_ScaledTarget : m_ScreenTarget; }
+
+    // Size picture of Update() by the current scale and draw to it by default
+    void ApplyResolution()
+    {
+        if (m_DynamicResolution)
+        {
+            m_ScaledTarget.Resize(m_Scaler.Scaled(m_Screen.x), m_Scaler.Scaled(m_Screen.y));
+            m_Frame = iVec2{ m_ScaledTarget.Width(), m_ScaledTarget.Height() };
+            SetDefaultTarget(&m_ScaledTarget);
+        }
+        else
+        {
+            m_Frame = m_Screen;
+            SetDefaultTarget(&m_ScreenTarget);
+        }
+    }
+
+public:
+    ///<summary> Draw Update() at lower resolution while frames take longer than budget, picture is stretched to the console </summary>
+    ///<param name="BudgetSeconds"> Time of frame work to hold, zero takes frame time of SetFramerate() </param>
+    ///<remarks> ScreenWidth(), ScreenHeight(), mouse and GetPixel() work in cells of the scaled picture.
+    ///          OnResize() is called every time the scale changes </remarks>
+    void EnableDynamicResolution(float MinScale = 0.5f, double BudgetSeconds = 0.0)
+    {
+        m_Scaler.SetLimits(MinScale);
+        m_Scaler.SetBudget(BudgetSeconds > 0.0 ? BudgetSeconds : std::chrono::duration<double>(m_FPS).count());
+        m_Scaler.Reset();
+        m_DynamicResolution = true;
+        ApplyResolution();
+        OnResize(m_Frame.x, m_Frame.y);
+    }
+    void DisableDynamicResolution()
+    {
+        if (!m_DynamicResolution)
+            return;
+        m_DynamicResolution = false;
+        ApplyResolution();
+        OnResize(m_Frame.x, m_Frame.y);
+    }
+    bool IsDynamicResolution() const { return m_DynamicResolution; }
+    // Part of console resolution along each axis the picture is drawn at
+    float GetResolutionScale() const { return m_DynamicResolution ? m_Scaler.Scale() : 1.0f; }
+    // Seconds of the last frame spent on Update(), systems and drawing, without waiting for the next one
+    double GetFrameWorkTime() const { return m_FrameWorkTime; }
+
+    /* Idle mode */
+private:
+    bool m_IdleMode = false;
+    std::chrono::milliseconds m_IdleMaxWait = CE_IDLE_MAX_WAIT;
+    std::atomic<bool> m_Animating{ false };
+    std::atomic<bool> m_RedrawRequested{ true };
+    std::mutex m_MutexRedrawTimer;
+    std::chrono::steady_clock::time_point m_RedrawAt = std::chrono::steady_clock::time_point::max();
+    HANDLE m_WakeEvent = NULL;
+    std::vector<Pixel> m_PresentedFrame;    // Copy of the last written frame, empty when it must be written again
+    bool m_FramePresented = true;
+
+    // Block on console input and wake event until the nearest redraw time
+    void WaitForWork()
+    {
+        while (m_ActiveMainThread)
+        {
+            if (m_Animating || m_RedrawRequested.exchange(false))
+                return;
+
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = now + m_IdleMaxWait;
+            {
+                std::lock_guard<std::mutex> lock(m_MutexRedrawTimer);
+                if (m_RedrawAt <= now)
+                {
+                    m_RedrawAt = std::chrono::steady_clock::time_point::max();
+                    return;
+                }
+                deadline = std::min(deadline, m_RedrawAt);
+            }
+
+            // Console input handle is signaled while it has unread mouse, focus or resize events
+            HANDLE handles[2] = { m_WakeEvent, hConsoleInput };
+            DWORD timeout = (DWORD)std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+            DWORD result = WaitForMultipleObjects(m_IsHeadless ? 1 : 2, handles, FALSE, timeout);
+
+            // Wake event only means that flags or timer changed, they are checked again
+            if (result != WAIT_OBJECT_0)
+            {
+                std::lock_guard<std::mutex> lock(m_MutexRedrawTimer);
+                if (m_RedrawAt <= std::chrono::steady_clock::now())
+                    m_RedrawAt = std::chrono::steady_clock::time_point::max();
+                return;
+            }
+        }
+    }
+
+    bool FrameChanged()
+    {
+        const size_t size = (size_t)m_Screen.x * m_Screen.y;
+        if (m_PresentedFrame.size() == size && memcmp(m_PresentedFrame.data(), m_ScreenBuffer, sizeof(Pixel) * size) == 0)
+            return false;
+        m_PresentedFrame.assign(m_ScreenBuffer, m_ScreenBuffer + size);
+        return true;
+    }
+
+public:
+    ///<summary> Run frames only on input, RequestRedraw() or timers instead of continuously </summary>
+    ///<param name="MaxWait"> Longest time without frames, e.g. for clocks in the title </param>
+    ///<remarks> Frames equal to the previous one are not written to console in this mode </remarks>
+    void SetIdleMode(bool Enabled, std::chrono::milliseconds MaxWait = CE_IDLE_MAX_WAIT)
+    {
+        m_IdleMode = Enabled;
+        m_IdleMaxWait = MaxWait;
+        m_PresentedFrame.clear();
+        RequestRedraw();
+    }
+    bool IsIdleMode() const { return m_IdleMode; }
+
+    // Run one more frame as soon as possible, safe to call from any thread
+    void RequestRedraw()
+    {
+        m_RedrawRequested = true;
+        SetEvent(m_WakeEvent);
+    }
+    // Run a frame after Delay, the earliest of requested times wins
+    void RequestRedrawIn(std::chrono::milliseconds Delay)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_MutexRedrawTimer);
+            m_RedrawAt = std::min(m_RedrawAt, std::chrono::steady_clock::now() + Delay);
+        }
+        SetEvent(m_WakeEvent);
+    }
+    // Frames run continuously while animating, even in idle mode
+    void SetAnimating(bool Animating)
+    {
+        m_Animating = Animating;
+        if (Animating)
+            SetEvent(m_WakeEvent);
+    }
+    bool IsAnimating() const { return m_Animating; }
+
+    // False if the last frame was skipped because nothing changed on screen
+    bool FramePresented() const { return m_FramePresented; }
+
+    /* Per frame memory */
+private:
+    FrameArena m_FrameArena;
+    size_t m_FrameIndex = 0;
+    size_t m_FrameAllocations = 0;
+
+public:
+    // Memory from arena is valid until the end of the current frame
+    FrameArena& GetFrameArena() { return m_FrameArena; }
+
+    // Count of operator new calls during the last frame, always zero without CE_DEBUG_ALLOCATIONS
+    size_t GetFrameAllocations() const { return m_FrameAllocations; }
+
+    /* Overdraw debugging */
+private:
+    OverdrawStats m_OverdrawStats;
+#ifdef CE_OVERDRAW
+    bool m_OverdrawOverlay = false;
+    std::vector<Pixel> m_OverdrawBackup;
+#endif
+
+public:
+    // Screen writes during the last frame, always empty without CE_OVERDRAW
+    const OverdrawStats& GetOverdrawStats() const { return m_OverdrawStats; }
+#ifdef CE_OVERDRAW
+    // Present heatmap of screen writes instead of the picture
+    void SetOverdrawOverlay(bool Show) { m_OverdrawOverlay = Show; }
+    bool GetOverdrawOverlay() const { return m_OverdrawOverlay; }
+#endif
+
     /* Timing things */
 private:
     std::chrono::duration<long long, std::ratio_multiply<std::hecto, std::nano>> m_FPS =
@@ -1120,14 +1445,53 @@ private:
         // the process will be killed before OnUserDestroy() has finished
         if (evt == CTRL_CLOSE_EVENT)
         {
-            CE_ActiveMainThread = false;
-            // Wait for thread to be exited
-            std::unique_lock<std::mutex> ul(CE_MutexFC);
-            CE_FinishedCondition.wait(ul);
+            // Registry is locked only to copy it, instances may be created or destroyed while we wait
+            std::vector<ConsoleEngine*> Closing;
+            {
+                std::lock_guard<std::mutex> lock(InstancesMutex());
+                Closing = Instances();
+                for (ConsoleEngine* Instance : Closing)
+                    ++Instance->m_CloseWaiters;
+            }
+            for (ConsoleEngine* Instance : Closing)
+                Instance->Quit();
+            // Wait for threads to be exited, every instance is released as soon as it finished
+            for (ConsoleEngine* Instance : Closing)
+            {
+                {
+                    std::unique_lock<std::mutex> ul(Instance->m_MutexFC);
+                    Instance->m_FinishedCondition.wait(ul, [Instance] { return Instance->m_Finished; });
+                }
+                {
+                    std::lock_guard<std::mutex> lock(InstancesMutex());
+                    --Instance->m_CloseWaiters;
+                }
+                InstancesCondition().notify_all();
+            }
         }
         return true;
     }
 
+    // Every alive engine of the process, the only shared state, needed by console close handler
+    static std::mutex& InstancesMutex()
+    {
+        static std::mutex Mutex;
+        return Mutex;
+    }
+    static std::vector<ConsoleEngine*>& Instances()
+    {
+        static std::vector<ConsoleEngine*> Registry;
+        return Registry;
+    }
+    // Signaled when close handler releases an instance
+    static std::condition_variable& InstancesCondition()
+    {
+        static std::condition_variable Condition;
+        return Condition;
+    }
+
+    int m_CloseWaiters = 0;             // Close handlers waiting for this instance, guarded by InstancesMutex()
+
 public:
     BOOL Error(const wchar_t *msg)
     {
@@ -1141,8 +1505,9 @@ public:
 
 private:
     std::wstring m_AppName;
+    wchar_t m_LastTitle[256] = { 0 };
 
-    CHAR_INFO *m_ScreenBuffer;
+    CHAR_INFO *m_ScreenBuffer = nullptr;
 
     HANDLE hOriginalConsole;
     CONSOLE_SCREEN_BUFFER_INFO hOriginalConsoleInfo;
@@ -1151,29 +1516,33 @@ private:
 
     HCURSOR hCursor;
 
-    uint16_t keysOldState[256] = { 0 };
-    uint16_t keysNewState[256] = { 0 };
-    bool mouseOldState[CE_MOUSE_MAX_BUTTONS + CE_MOUSE_ADDITIONAL_EVENTS] = { 0 };
-    bool mouseNewState[CE_MOUSE_MAX_BUTTONS + CE_MOUSE_ADDITIONAL_EVENTS] = { 0 };
-
     bool ConsoleInFocus = true;
 
-    static std::atomic<bool> CE_ActiveMainThread;
+    std::atomic<bool> m_ActiveMainThread{ false };
 
-    static std::condition_variable CE_FinishedCondition;
-    static std::mutex CE_MutexFC;
+    bool m_Finished = true;
+    std::condition_variable m_FinishedCondition;
+    std::mutex m_MutexFC;
 
-    static std::mutex CE_MutexInputModifying;
+    std::mutex m_MutexInputModifying;
 };
 
-std::atomic<bool> ConsoleEngine::CE_ActiveMainThread(false);
-std::condition_variable ConsoleEngine::CE_FinishedCondition;
-std::mutex ConsoleEngine::CE_MutexFC;
-std::mutex ConsoleEngine::CE_MutexInputModifying;
-
-List<KeyInfo> ConsoleEngine::CE_KeyBuffer;
-HHOOK ConsoleEngine::CE_Hook;
-KeyInfo ConsoleEngine::CE_LastKUI;
+#if defined(CE_DEBUG_ALLOCATIONS) && defined(CE_DEBUG_ALLOCATIONS_IMPLEMENTATION)
+// Replacement of global allocation functions, counts every allocation of the process.
+// They may be defined only once per program, so only the implementation translation unit emits them
+void* operator new(size_t Size)
+{
+    ++CE_AllocationCount;
+    if (void* memory = malloc(Size ? Size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t Size) { return operator new(Size); }
+void operator delete(void* Memory) noexcept { free(Memory); }
+void operator delete[](void* Memory) noexcept { free(Memory); }
+void operator delete(void* Memory, size_t) noexcept { free(Memory); }
+void operator delete[](void* Memory, size_t) noexcept { free(Memory); }
+#endif
 
 //------- Useful utilities ---------------------------------------------------------------------------
 
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <stdint.h>
+#include <vector>
+
+#define CE_DEFERRED_BAND_ROWS 8     // Rows of one band, every band is drawn by one thread
+
+// Draw* calls that can be recorded
+enum class DRAW_COMMAND : uint8_t
+{
+    PIXEL,
+    PIXEL_UNSAFE,
+    RECT,
+    LINE,
+    CIRCLE,
+    FILL_CIRCLE,
+    SPAN,               // Pixels are copied into the list
+    PIXELS,             // Coordinates are copied into the list
+    PIXELS_COLORED,     // Coordinates, characters and colors are copied into the list
+    BLIT,               // Source is read when the list is executed
+    COMPOSITE
+};
+
+// One recorded call with the state it was made in
+struct DrawCommand
+{
+    DRAW_COMMAND Type;
+    short Mode;                 // DRAW_MODE at the moment of call
+    short Parameter;            // Transparent key or shade glyph of the mode
+    short Character, Color;     // Key character for COMPOSITE
+    int x1, y1, x2, y2;         // Points, rect, or center and radius in x1, y1, x2
+    uint32_t Payload, Count;    // Range of copied data
+    const RenderTarget* Source;
+    ClipRect Clip;
+};
+
+/* Draw calls of one frame binned by bands of rows they touch. A cell belongs to one band
+   and a bin keeps submission order, so bands executed on different threads give the same picture */
+class DrawCommandList
+{
+public:
+    // Drop recorded commands and bin for a target of Height rows, memory is kept
+    void Reset(int Height)
+    {
+        for (auto& bin : m_Bins)
+            bin.clear();
+        m_Bins.resize((Height + CE_DEFERRED_BAND_ROWS - 1) / CE_DEFERRED_BAND_ROWS);
+        m_Commands.clear();
+        m_Pixels.clear();
+        m_Coordinates.clear();
+        m_Attributes.clear();
+        m_Height = Height;
+    }
+
+    bool Empty() const { return m_Commands.empty(); }
+    size_t Size() const { return m_Commands.size(); }
+    int Height() const { return m_Height; }
+
+    ///<summary> Add command that writes only rows [y1, y2), it goes to every band they overlap </summary>
+    ///<remarks> Rows out of the target are dropped, command with no rows left isn't added </remarks>
+    void Add(const DrawCommand& Command, int y1, int y2)
+    {
+        y1 = std::max(y1, 0);
+        y2 = std::min(y2, m_Height);
+        if (y1 >= y2)
+            return;
+        const uint32_t index = (uint32_t)m_Commands.size();
+        m_Commands.push_back(Command);
+        for (int band = y1 / CE_DEFERRED_BAND_ROWS; band <= (y2 - 1) / CE_DEFERRED_BAND_ROWS; ++band)
+            m_Bins[band].push_back(index);
+    }
+
+    size_t Bands() const { return m_Bins.size(); }
+    // Rows [Top, Bottom) of the band
+    int BandTop(size_t Band) const { return (int)Band * CE_DEFERRED_BAND_ROWS; }
+    int BandBottom(size_t Band) const { return std::min(BandTop(Band) + CE_DEFERRED_BAND_ROWS, m_Height); }
+    // Indices of commands of the band in submission order
+    const std::vector<uint32_t>& Bin(size_t Band) const { return m_Bins[Band]; }
+    const DrawCommand& operator[](size_t Index) const { return m_Commands[Index]; }
+
+    /* Copied data of commands */
+public:
+    uint32_t AddPixels(const Pixel* Pixels, int Count)
+    {
+        const uint32_t offset = (uint32_t)m_Pixels.size();
+        m_Pixels.insert(m_Pixels.end(), Pixels, Pixels + Count);
+        return offset;
+    }
+    // Space for Count ints, e.g. X then Y coordinates of a batch
+    uint32_t AllocateCoordinates(size_t Count)
+    {
+        const uint32_t offset = (uint32_t)m_Coordinates.size();
+        m_Coordinates.resize(m_Coordinates.size() + Count);
+        return offset;
+    }
+    uint32_t AllocateAttributes(size_t Count)
+    {
+        const uint32_t offset = (uint32_t)m_Attributes.size();
+        m_Attributes.resize(m_Attributes.size() + Count);
+        return offset;
+    }
+
+    const Pixel* Pixels(uint32_t Offset) const { return m_Pixels.data() + Offset; }
+    int* Coordinates(uint32_t Offset) { return m_Coordinates.data() + Offset; }
+    const int* Coordinates(uint32_t Offset) const { return m_Coordinates.data() + Offset; }
+    short* Attributes(uint32_t Offset) { return m_Attributes.data() + Offset; }
+    const short* Attributes(uint32_t Offset) const { return m_Attributes.data() + Offset; }
+
+private:
+    std::vector<DrawCommand> m_Commands;
+    std::vector<std::vector<uint32_t>> m_Bins;
+    std::vector<Pixel> m_Pixels;
+    std::vector<int> m_Coordinates;
+    std::vector<short> m_Attributes;
+    int m_Height = 0;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <assert.h>
+#include <type_traits>
+
+/* Clip policies, decide how much kernel checks coordinates */
+
+// Nothing is checked, caller guarantees coordinates inside the buffer
+struct ClipNone
+{
+    static constexpr bool Clips = false;
+    static void Verify(const RenderTarget&, int, int, int) {}
+};
+
+// Caller already clipped the whole primitive by the clip rect, checked only in debug
+struct ClipPreclipped
+{
+    static constexpr bool Clips = false;
+    static void Verify(const RenderTarget& Target, int x, int y, int Length)
+    {
+        assert(Target.Clip().Contains(x, y) && x + Length <= Target.Clip().Right && "Primitive is not preclipped");
+    }
+};
+
+// Every write is clipped by the clip rect of target
+struct ClipToRect
+{
+    static constexpr bool Clips = true;
+    static void Verify(const RenderTarget&, int, int, int) {}
+};
+
+/* Write policies, decide what part of the cell is written. All of them are built from
+   the drawn pixel and one mode parameter, so the engine constructs them the same way */
+
+// Replace the whole cell
+struct WriteOverwrite
+{
+    Pixel Value;
+    WriteOverwrite(Pixel Value, short) : Value(Value) {}
+
+    void Plot(Pixel& To) const { To = Value; }
+    void Fill(Pixel* To, int Length) const { std::fill_n(To, Length, Value); }
+    void Copy(Pixel* To, const Pixel* From, int Length) const { memcpy(To, From, sizeof(Pixel) * Length); }
+};
+
+// Replace only characters, cells keep their colors
+struct WriteGlyph
+{
+    short Character;
+    WriteGlyph(Pixel Value, short) : Character(Value.Char.UnicodeChar) {}
+
+    void Plot(Pixel& To) const { To.Char.UnicodeChar = Character; }
+    void Fill(Pixel* To, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+            To[i].Char.UnicodeChar = Character;
+    }
+    void Copy(Pixel* To, const Pixel* From, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+            To[i].Char.UnicodeChar = From[i].Char.UnicodeChar;
+    }
+};
+
+// Replace only colors, cells keep their characters
+struct WriteAttribute
+{
+    short Color;
+    WriteAttribute(Pixel Value, short) : Color(Value.Attributes) {}
+
+    void Plot(Pixel& To) const { To.Attributes = Color; }
+    void Fill(Pixel* To, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+            To[i].Attributes = Color;
+    }
+    void Copy(Pixel* To, const Pixel* From, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+            To[i].Attributes = From[i].Attributes;
+    }
+};
+
+// Cells with the key character are not written
+struct WriteKeyed
+{
+    Pixel Value;
+    short Key;
+    WriteKeyed(Pixel Value, short Key) : Value(Value), Key(Key) {}
+
+    void Plot(Pixel& To) const
+    {
+        if (Value.Char.UnicodeChar != Key)
+            To = Value;
+    }
+    void Fill(Pixel* To, int Length) const
+    {
+        if (Value.Char.UnicodeChar != Key)
+            std::fill_n(To, Length, Value);
+    }
+    void Copy(Pixel* To, const Pixel* From, int Length) const { RenderTarget::CompositeSpan(To, From, Length, Key); }
+};
+
+// Shade glyph with drawn color in front of the color that was in the cell
+struct WriteShade
+{
+    short Shade;
+    short Foreground;
+    WriteShade(Pixel Value, short Shade) : Shade(Shade), Foreground(Value.Attributes & 0x0F) {}
+
+    void Plot(Pixel& To) const
+    {
+        To.Attributes = Foreground | ((To.Attributes & 0x0F) << 4);
+        To.Char.UnicodeChar = Shade;
+    }
+    void Fill(Pixel* To, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+            Plot(To[i]);
+    }
+    void Copy(Pixel* To, const Pixel* From, int Length) const
+    {
+        for (int i = 0; i < Length; ++i)
+        {
+            To[i].Attributes = (From[i].Attributes & 0x0F) | ((To[i].Attributes & 0x0F) << 4);
+            To[i].Char.UnicodeChar = Shade;
+        }
+    }
+};
+
+///<summary> Draw primitives specialized at compile time by clip and write policies </summary>
+///<remarks> Policies inline into the loops, so e.g. preclipped overwrite fill is a plain fill_n </remarks>
+template < typename Clip, typename Write >
+struct DrawKernel
+{
+    static void Plot(RenderTarget& Target, int x, int y, const Write& Writer)
+    {
+        if (Clip::Clips && !Target.Clip().Contains(x, y))
+            return;
+        Clip::Verify(Target, x, y, 1);
+        Pixel* cell = Target.Row(y) + x;
+        Writer.Plot(*cell);
+        Target.CountWrites(cell, 1);
+    }
+
+    // Horizontal run of Length cells starting at (x,y)
+    static void Fill(RenderTarget& Target, int x, int y, int Length, const Write& Writer)
+    {
+        if (Clip::Clips && !ClipSpan(Target.Clip(), x, y, Length, nullptr))
+            return;
+        Clip::Verify(Target, x, y, Length);
+        Writer.Fill(Target.Row(y) + x, Length);
+        Target.CountWrites(Target.Row(y) + x, Length);
+    }
+
+    static void Copy(RenderTarget& Target, int x, int y, const Pixel* Span, int Length, const Write& Writer)
+    {
+        if (Clip::Clips && !ClipSpan(Target.Clip(), x, y, Length, &Span))
+            return;
+        Clip::Verify(Target, x, y, Length);
+        Writer.Copy(Target.Row(y) + x, Span, Length);
+        Target.CountWrites(Target.Row(y) + x, Length);
+    }
+
+    // Cells [x1, x2) x [y1, y2), clipped once and filled row by row
+    static void Rect(RenderTarget& Target, int x1, int y1, int x2, int y2, const Write& Writer)
+    {
+        if (Clip::Clips)
+        {
+            const ClipRect& clip = Target.Clip();
+            x1 = std::max(x1, clip.Left);
+            y1 = std::max(y1, clip.Top);
+            x2 = std::min(x2, clip.Right);
+            y2 = std::min(y2, clip.Bottom);
+        }
+        if (x1 >= x2)
+            return;
+
+        // Rows are inside after clipping once, otherwise they keep the caller's guarantee
+        using RowKernel = DrawKernel<typename std::conditional<Clip::Clips, ClipNone, Clip>::type, Write>;
+        for (int y = y1; y < y2; ++y)
+            RowKernel::Fill(Target, x1, y, x2 - x1, Writer);
+    }
+
+private:
+    static bool ClipSpan(const ClipRect& Bounds, int& x, int y, int& Length, const Pixel** Span)
+    {
+        if (y < Bounds.Top || y >= Bounds.Bottom)
+            return false;
+        if (x < Bounds.Left)
+        {
+            if (Span)
+                *Span += Bounds.Left - x;
+            Length -= Bounds.Left - x;
+            x = Bounds.Left;
+        }
+        if (x + Length > Bounds.Right)
+            Length = Bounds.Right - x;
+        return Length > 0;
+    }
+};
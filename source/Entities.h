@@ -0,0 +1,410 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <type_traits>
+
+#include <stf/WorkerPool.h>
+
+// Maximum count of different component types, one bit of ComponentMask per type
+#define CE_ECS_MAX_COMPONENTS 64
+
+typedef uint64_t ComponentMask;
+
+// Handle of entity, generation invalidates handles of destroyed entities
+struct Entity
+{
+    uint32_t Index = 0xFFFFFFFF;
+    uint32_t Generation = 0;
+
+    bool operator==(const Entity& Other) const { return Index == Other.Index && Generation == Other.Generation; }
+    bool operator!=(const Entity& Other) const { return !(*this == Other); }
+};
+
+// Sequential id for every component type
+class ComponentType
+{
+public:
+    template < typename T >
+    static size_t Id()
+    {
+        static const size_t id = NextId();
+        return id;
+    }
+
+    template < typename ... T >
+    static ComponentMask Mask()
+    {
+        return (ComponentMask{ 0 } | ... | (ComponentMask{ 1 } << Id<T>()));
+    }
+
+private:
+    static size_t NextId()
+    {
+        static std::atomic<size_t> counter{ 0 };
+        size_t id = counter++;
+        assert(id < CE_ECS_MAX_COMPONENTS && "Too many component types, increase CE_ECS_MAX_COMPONENTS");
+        return id;
+    }
+};
+
+/* Entities with the same set of components, every component stored in its own array */
+class Archetype
+{
+public:
+    struct Column
+    {
+        size_t Id;
+        size_t Size;
+        std::vector<uint8_t> Data;
+    };
+
+    ComponentMask Mask() const { return m_Mask; }
+    size_t Count() const { return m_Entities.size(); }
+    const Entity* Entities() const { return m_Entities.data(); }
+
+    template < typename T >
+    T* Components()
+    {
+        Column* column = FindColumn(ComponentType::Id<T>());
+        return column ? reinterpret_cast<T*>(column->Data.data()) : nullptr;
+    }
+
+    Column* FindColumn(size_t Id)
+    {
+        for (auto& column : m_Columns)
+            if (column.Id == Id)
+                return &column;
+        return nullptr;
+    }
+
+private:
+    friend class World;
+
+    // Append uninitialized row, return its index
+    size_t PushRow(Entity Owner)
+    {
+        for (auto& column : m_Columns)
+            column.Data.resize(column.Data.size() + column.Size);
+        m_Entities.push_back(Owner);
+        return m_Entities.size() - 1;
+    }
+
+    // Remove row by moving the last one into its place, return entity that was moved
+    Entity SwapRemoveRow(size_t Row)
+    {
+        size_t last = m_Entities.size() - 1;
+        for (auto& column : m_Columns)
+        {
+            if (Row != last)
+                memcpy(column.Data.data() + Row * column.Size, column.Data.data() + last * column.Size, column.Size);
+            column.Data.resize(column.Data.size() - column.Size);
+        }
+        m_Entities[Row] = m_Entities[last];
+        m_Entities.pop_back();
+        return Row != last ? m_Entities[Row] : Entity{};
+    }
+
+    ComponentMask m_Mask = 0;
+    std::vector<Column> m_Columns;
+    std::vector<Entity> m_Entities;
+};
+
+/* Entities, components storage and systems schedule */
+class World
+{
+public:
+    typedef std::function<void(World&, double)> SystemFunc;
+
+    World()
+    {
+        // Archetype without components for new entities
+        m_Archetypes.emplace_back(new Archetype);
+        m_ArchetypeByMask[0] = m_Archetypes.back().get();
+    }
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    /* Entities */
+public:
+    Entity Create()
+    {
+        Entity entity;
+        if (!m_FreeIndices.empty())
+        {
+            entity.Index = m_FreeIndices.back();
+            m_FreeIndices.pop_back();
+        }
+        else
+        {
+            entity.Index = (uint32_t)m_Records.size();
+            m_Records.push_back({});
+        }
+        Record& record = m_Records[entity.Index];
+        entity.Generation = record.Generation;
+        record.Owner = m_Archetypes.front().get();
+        record.Row = record.Owner->PushRow(entity);
+        return entity;
+    }
+
+    void Destroy(Entity Target)
+    {
+        if (!IsAlive(Target))
+            return;
+        Record& record = m_Records[Target.Index];
+        RemoveRow(record);
+        record.Owner = nullptr;
+        ++record.Generation;
+        m_FreeIndices.push_back(Target.Index);
+    }
+
+    bool IsAlive(Entity Target) const
+    {
+        return Target.Index < m_Records.size()
+            && m_Records[Target.Index].Owner
+            && m_Records[Target.Index].Generation == Target.Generation;
+    }
+
+    // Add component or overwrite existing one
+    template < typename T >
+    T& Add(Entity Target, const T& Value = T{})
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Components are moved with memcpy, they must be trivially copyable");
+        static_assert(alignof(T) <= alignof(max_align_t), "Over aligned components are not supported");
+        assert(IsAlive(Target));
+
+        Record& record = m_Records[Target.Index];
+        const size_t id = ComponentType::Id<T>();
+        const ComponentMask bit = ComponentMask{ 1 } << id;
+        if (!(record.Owner->Mask() & bit))
+            MoveEntity(record, GetArchetype(record.Owner->Mask() | bit, record.Owner, id, sizeof(T)));
+
+        T* component = record.Owner->Components<T>() + record.Row;
+        *component = Value;
+        return *component;
+    }
+
+    template < typename T >
+    void Remove(Entity Target)
+    {
+        if (!Has<T>(Target))
+            return;
+        Record& record = m_Records[Target.Index];
+        MoveEntity(record, GetArchetype(record.Owner->Mask() & ~(ComponentMask{ 1 } << ComponentType::Id<T>()), record.Owner, 0, 0));
+    }
+
+    template < typename T >
+    bool Has(Entity Target) const
+    {
+        return IsAlive(Target) && (m_Records[Target.Index].Owner->Mask() & ComponentType::Mask<T>());
+    }
+
+    // Return nullptr if entity don't have component
+    template < typename T >
+    T* Get(Entity Target)
+    {
+        if (!Has<T>(Target))
+            return nullptr;
+        const Record& record = m_Records[Target.Index];
+        return record.Owner->Components<T>() + record.Row;
+    }
+
+    size_t EntityCount() const { return m_Records.size() - m_FreeIndices.size(); }
+
+    /* Queries */
+public:
+    ///<summary> Call Func(Entity, Ts&...) for every entity that has all of Ts components </summary>
+    ///<remarks> Iterates archetypes array by array, don't add or remove components inside of Func, use Defer </remarks>
+    template < typename ... Ts, typename Func >
+    void Each(Func&& Function)
+    {
+        const ComponentMask mask = ComponentType::Mask<Ts...>();
+        for (auto& archetype : m_Archetypes)
+            if ((archetype->Mask() & mask) == mask && archetype->Count() > 0)
+                EachInArchetype<Ts...>(*archetype, Function, std::index_sequence_for<Ts...>{});
+    }
+
+    ///<summary> Call Func(Count, const Entity*, Ts*...) once per archetype with matching arrays </summary>
+    template < typename ... Ts, typename Func >
+    void EachArray(Func&& Function)
+    {
+        const ComponentMask mask = ComponentType::Mask<Ts...>();
+        for (auto& archetype : m_Archetypes)
+            if ((archetype->Mask() & mask) == mask && archetype->Count() > 0)
+                Function(archetype->Count(), archetype->Entities(), archetype->template Components<Ts>()...);
+    }
+
+    // Postpone structural change (create, destroy, add, remove) until all systems are done
+    void Defer(std::function<void(World&)> Command)
+    {
+        std::lock_guard<std::mutex> lock(m_DeferredMutex);
+        m_Deferred.push_back(std::move(Command));
+    }
+
+    /* Systems */
+public:
+    ///<summary> Register system that runs every frame in registration order </summary>
+    ///<param name="Reads"> Components that system only reads, ComponentType::Mask&lt;...&gt;() </param>
+    ///<param name="Writes"> Components that system modifies </param>
+    ///<remarks> Neighbour systems without data conflicts run in parallel on the worker pool </remarks>
+    void AddSystem(ComponentMask Reads, ComponentMask Writes, SystemFunc Function)
+    {
+        m_Systems.push_back({ Reads, Writes, std::move(Function) });
+        m_StagesDirty = true;
+    }
+
+    void ClearSystems()
+    {
+        m_Systems.clear();
+        m_Stages.clear();
+    }
+
+    size_t SystemCount() const { return m_Systems.size(); }
+
+    // Run every system once, then apply deferred commands
+    void RunSystems(double DeltaTime)
+    {
+        if (m_StagesDirty)
+            BuildStages();
+
+        for (auto& stage : m_Stages)
+        {
+            if (stage.size() == 1)
+            {
+                m_Systems[stage.front()].Function(*this, DeltaTime);
+                continue;
+            }
+
+            if (!m_Pool)
+                m_Pool.reset(new WorkerPool);
+            m_Pool->ParallelFor(stage.size(), [&](size_t i) { m_Systems[stage[i]].Function(*this, DeltaTime); });
+        }
+
+        FlushDeferred();
+    }
+
+    void FlushDeferred()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_DeferredMutex);
+            m_DeferredRunning.swap(m_Deferred);
+        }
+        // Both vectors keep their memory, so steady frames don't allocate here
+        for (auto& command : m_DeferredRunning)
+            command(*this);
+        m_DeferredRunning.clear();
+    }
+
+private:
+    struct Record
+    {
+        Archetype* Owner = nullptr;
+        size_t Row = 0;
+        uint32_t Generation = 0;
+    };
+
+    struct System
+    {
+        ComponentMask Reads;
+        ComponentMask Writes;
+        SystemFunc Function;
+    };
+
+    template < typename ... Ts, typename Func, size_t ... I >
+    static void EachInArchetype(Archetype& Arch, Func& Function, std::index_sequence<I...>)
+    {
+        std::tuple<Ts*...> columns{ Arch.Components<Ts>()... };
+        const Entity* entities = Arch.Entities();
+        const size_t count = Arch.Count();
+        for (size_t row = 0; row < count; ++row)
+            Function(entities[row], std::get<I>(columns)[row]...);
+    }
+
+    // Find archetype by mask or create it from the source one plus column (Id, Size)
+    Archetype* GetArchetype(ComponentMask Mask, const Archetype* Source, size_t Id, size_t Size)
+    {
+        auto found = m_ArchetypeByMask.find(Mask);
+        if (found != m_ArchetypeByMask.end())
+            return found->second;
+
+        Archetype* archetype = new Archetype;
+        archetype->m_Mask = Mask;
+        for (auto& column : Source->m_Columns)
+            if (Mask & (ComponentMask{ 1 } << column.Id))
+                archetype->m_Columns.push_back({ column.Id, column.Size, {} });
+        if (Size && !archetype->FindColumn(Id))
+            archetype->m_Columns.push_back({ Id, Size, {} });
+
+        m_Archetypes.emplace_back(archetype);
+        m_ArchetypeByMask[Mask] = archetype;
+        return archetype;
+    }
+
+    void MoveEntity(Record& Rec, Archetype* Target)
+    {
+        Archetype* source = Rec.Owner;
+        Entity entity = source->m_Entities[Rec.Row];
+        size_t row = Target->PushRow(entity);
+        for (auto& column : Target->m_Columns)
+            if (Archetype::Column* from = source->FindColumn(column.Id))
+                memcpy(column.Data.data() + row * column.Size, from->Data.data() + Rec.Row * column.Size, column.Size);
+        RemoveRow(Rec);
+        Rec.Owner = Target;
+        Rec.Row = row;
+    }
+
+    void RemoveRow(Record& Rec)
+    {
+        Entity moved = Rec.Owner->SwapRemoveRow(Rec.Row);
+        if (moved.Index != Entity{}.Index)
+            m_Records[moved.Index].Row = Rec.Row;
+    }
+
+    // Greedy split of systems into stages, system joins the last stage if it don't conflict with any of it
+    void BuildStages()
+    {
+        m_Stages.clear();
+        ComponentMask stage_reads = 0, stage_writes = 0;
+        for (size_t i = 0; i < m_Systems.size(); ++i)
+        {
+            const System& system = m_Systems[i];
+            bool conflict = (system.Writes & (stage_reads | stage_writes)) || (system.Reads & stage_writes);
+            if (m_Stages.empty() || conflict)
+            {
+                m_Stages.emplace_back();
+                stage_reads = stage_writes = 0;
+            }
+            m_Stages.back().push_back(i);
+            stage_reads |= system.Reads;
+            stage_writes |= system.Writes;
+        }
+        m_StagesDirty = false;
+    }
+
+    std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+    std::unordered_map<ComponentMask, Archetype*> m_ArchetypeByMask;
+
+    std::vector<Record> m_Records;
+    std::vector<uint32_t> m_FreeIndices;
+
+    std::vector<System> m_Systems;
+    std::vector<std::vector<size_t>> m_Stages;
+    bool m_StagesDirty = false;
+    std::unique_ptr<WorkerPool> m_Pool;
+
+    std::mutex m_DeferredMutex;
+    std::vector<std::function<void(World&)>> m_Deferred;
+    std::vector<std::function<void(World&)>> m_DeferredRunning;
+};
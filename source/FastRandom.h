@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+
+#define CE_RANDOM_LANES 4      // Independent generators stepped together, one SSE2 register per state word
+#define CE_RANDOM_BLOCK 256    // Values generated at once when output needs conversion
+
+/* xoshiro128** generator with four lanes, made for filling whole buffers with noise.
+   SIMD and scalar paths step the same lanes, so sequences don't depend on the build */
+class FastRandom
+{
+public:
+    explicit FastRandom(uint64_t Seed = 0x9E3779B97F4A7C15ull) { SetSeed(Seed); }
+
+    // Lanes are seeded by splitmix64, so any seed including zero gives good state
+    void SetSeed(uint64_t Seed)
+    {
+        for (int lane = 0; lane < CE_RANDOM_LANES; ++lane)
+            for (int word = 0; word < 4; word += 2)
+            {
+                uint64_t value = SplitMix64(Seed);
+                m_State[word][lane] = (uint32_t)value;
+                m_State[word + 1][lane] = (uint32_t)(value >> 32);
+            }
+        m_Used = CE_RANDOM_LANES;
+    }
+
+    /* Single values */
+public:
+    uint32_t NextU32()
+    {
+        if (m_Used == CE_RANDOM_LANES)
+        {
+            Generate(m_Buffered, CE_RANDOM_LANES);
+            m_Used = 0;
+        }
+        return m_Buffered[m_Used++];
+    }
+
+    // Uniform in [0, 1)
+    float NextFloat() { return (NextU32() >> 8) * (1.0f / 16777216.0f); }
+    float NextFloat(float Min, float Max) { return Min + (Max - Min) * NextFloat(); }
+
+    ///<summary> Uniform integer in [Min, Max) without modulo bias, Min for empty range </summary>
+    int NextRange(int Min, int Max)
+    {
+        uint32_t range = (uint32_t)Max - (uint32_t)Min;
+        return (int)((uint32_t)Min + Bounded(NextU32(), range));
+    }
+
+    /* Bulk calls, cost of a value is a few instructions */
+public:
+    void FillU32(uint32_t* Out, size_t Count)
+    {
+        size_t i = 0;
+        // Leftovers of the single value buffer go first, so bulk and single calls share one sequence
+        while (i < Count && m_Used < CE_RANDOM_LANES)
+            Out[i++] = m_Buffered[m_Used++];
+        size_t whole = (Count - i) & ~(size_t)(CE_RANDOM_LANES - 1);
+        Generate(Out + i, whole);
+        for (i += whole; i < Count; ++i)
+            Out[i] = NextU32();
+    }
+
+    // Uniform floats in [Min, Max)
+    void FillFloats(float* Out, size_t Count, float Min = 0.0f, float Max = 1.0f)
+    {
+        // Bits go through a small stack block, 24 bit values convert to float exactly
+        const float scale = (Max - Min) * (1.0f / 16777216.0f);
+        alignas(16) uint32_t bits[CE_RANDOM_BLOCK];
+        for (size_t begin = 0; begin < Count; begin += CE_RANDOM_BLOCK)
+        {
+            size_t count = std::min((size_t)CE_RANDOM_BLOCK, Count - begin);
+            FillU32(bits, count);
+            float* out = Out + begin;
+            size_t i = 0;
+#ifdef CE_SIMD_SSE2
+            const __m128 min = _mm_set1_ps(Min);
+            const __m128 factor = _mm_set1_ps(scale);
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i value = _mm_srli_epi32(_mm_load_si128((const __m128i*)(bits + i)), 8);
+                _mm_storeu_ps(out + i, _mm_add_ps(min, _mm_mul_ps(_mm_cvtepi32_ps(value), factor)));
+            }
+#endif
+            for (; i < count; ++i)
+                out[i] = Min + (bits[i] >> 8) * scale;
+        }
+    }
+
+    ///<summary> Uniform integers in [Min, Max) without modulo bias </summary>
+    ///<remarks> Lemire's multiply and shift, rejected values are redrawn one by one and are rare for small ranges </remarks>
+    void FillRange(int* Out, size_t Count, int Min, int Max)
+    {
+        uint32_t* bits = reinterpret_cast<uint32_t*>(Out);
+        FillU32(bits, Count);
+        const uint32_t range = (uint32_t)Max - (uint32_t)Min;
+        if (range == 0)
+        {
+            std::fill_n(Out, Count, Min);
+            return;
+        }
+        const uint32_t threshold = (0u - range) % range;
+        for (size_t i = 0; i < Count; ++i)
+        {
+            uint64_t product = (uint64_t)bits[i] * range;
+            while ((uint32_t)product < threshold)
+                product = (uint64_t)NextU32() * range;
+            bits[i] = (uint32_t)Min + (uint32_t)(product >> 32);
+        }
+    }
+
+private:
+    static uint64_t SplitMix64(uint64_t& State)
+    {
+        uint64_t z = (State += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t Bounded(uint32_t Value, uint32_t Range)
+    {
+        if (Range == 0)
+            return 0;
+        uint64_t product = (uint64_t)Value * Range;
+        if ((uint32_t)product < Range)
+        {
+            const uint32_t threshold = (0u - Range) % Range;
+            while ((uint32_t)product < threshold)
+                product = (uint64_t)NextU32() * Range;
+        }
+        return (uint32_t)(product >> 32);
+    }
+
+    static uint32_t Rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+    // Count is multiple of lanes, output i comes from lane i % CE_RANDOM_LANES
+    void Generate(uint32_t* Out, size_t Count)
+    {
+#ifdef CE_SIMD_SSE2
+        __m128i s0 = _mm_load_si128((const __m128i*)m_State[0]);
+        __m128i s1 = _mm_load_si128((const __m128i*)m_State[1]);
+        __m128i s2 = _mm_load_si128((const __m128i*)m_State[2]);
+        __m128i s3 = _mm_load_si128((const __m128i*)m_State[3]);
+        for (size_t i = 0; i < Count; i += CE_RANDOM_LANES)
+        {
+            // rotl(s1 * 5, 7) * 9, multiplications by shifts since SSE2 has no 32 bit mullo
+            __m128i x = _mm_add_epi32(_mm_slli_epi32(s1, 2), s1);
+            x = _mm_or_si128(_mm_slli_epi32(x, 7), _mm_srli_epi32(x, 25));
+            x = _mm_add_epi32(_mm_slli_epi32(x, 3), x);
+            _mm_storeu_si128((__m128i*)(Out + i), x);
+
+            __m128i t = _mm_slli_epi32(s1, 9);
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        }
+        _mm_store_si128((__m128i*)m_State[0], s0);
+        _mm_store_si128((__m128i*)m_State[1], s1);
+        _mm_store_si128((__m128i*)m_State[2], s2);
+        _mm_store_si128((__m128i*)m_State[3], s3);
+#else
+        for (size_t i = 0; i < Count; i += CE_RANDOM_LANES)
+            for (int lane = 0; lane < CE_RANDOM_LANES; ++lane)
+            {
+                uint32_t& s0 = m_State[0][lane];
+                uint32_t& s1 = m_State[1][lane];
+                uint32_t& s2 = m_State[2][lane];
+                uint32_t& s3 = m_State[3][lane];
+                Out[i + lane] = Rotl(s1 * 5, 7) * 9;
+                uint32_t t = s1 << 9;
+                s2 ^= s0;
+                s3 ^= s1;
+                s1 ^= s2;
+                s0 ^= s3;
+                s2 ^= t;
+                s3 = Rotl(s3, 11);
+            }
+#endif
+    }
+
+    alignas(16) uint32_t m_State[4][CE_RANDOM_LANES];     // State word, then lane
+    uint32_t m_Buffered[CE_RANDOM_LANES];
+    int m_Used = CE_RANDOM_LANES;
+};
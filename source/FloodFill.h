@@ -0,0 +1,279 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Which part of the cell must be equal to the seed cell to be filled
+enum class FILL_MATCH : short
+{
+    GLYPH = 0x0,
+    ATTRIBUTE,
+    BOTH
+};
+
+/* One bit per cell, rows padded to 64 bit words so every operation goes 64 cells at once */
+class CellMask
+{
+public:
+    CellMask() = default;
+    CellMask(int Width, int Height) { Resize(Width, Height); }
+
+    // Memory is kept when size shrinks, all bits are cleared
+    void Resize(int Width, int Height)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Stride = (Width + 63) / 64;
+        m_Words.assign((size_t)m_Stride * Height, 0);
+    }
+    void Clear() { std::fill(m_Words.begin(), m_Words.end(), 0); }
+
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+
+    bool Test(int x, int y) const { return (Row(y)[x >> 6] >> (x & 63)) & 1; }
+    void Set(int x, int y) { Row(y)[x >> 6] |= 1ull << (x & 63); }
+    void Reset(int x, int y) { Row(y)[x >> 6] &= ~(1ull << (x & 63)); }
+
+    // Set cells [x1, x2) of the row
+    void SetSpan(int y, int x1, int x2)
+    {
+        uint64_t* row = Row(y);
+        int first = x1 >> 6, last = (x2 - 1) >> 6;
+        uint64_t head = ~0ull << (x1 & 63);
+        uint64_t tail = ~0ull >> (63 - ((x2 - 1) & 63));
+        if (first == last)
+        {
+            row[first] |= head & tail;
+            return;
+        }
+        row[first] |= head;
+        for (int i = first + 1; i < last; ++i)
+            row[i] = ~0ull;
+        row[last] |= tail;
+    }
+
+    /* Set operations, masks must have the same size */
+public:
+    CellMask& Union(const CellMask& Other)
+    {
+        assert(SameSize(Other));
+        for (size_t i = 0; i < m_Words.size(); ++i)
+            m_Words[i] |= Other.m_Words[i];
+        return *this;
+    }
+    CellMask& Intersect(const CellMask& Other)
+    {
+        assert(SameSize(Other));
+        for (size_t i = 0; i < m_Words.size(); ++i)
+            m_Words[i] &= Other.m_Words[i];
+        return *this;
+    }
+    CellMask& Subtract(const CellMask& Other)
+    {
+        assert(SameSize(Other));
+        for (size_t i = 0; i < m_Words.size(); ++i)
+            m_Words[i] &= ~Other.m_Words[i];
+        return *this;
+    }
+    CellMask& Invert()
+    {
+        for (size_t i = 0; i < m_Words.size(); ++i)
+            m_Words[i] = ~m_Words[i];
+        // Padding bits past the width stay zero
+        if (m_Width & 63)
+            for (int y = 0; y < m_Height; ++y)
+                Row(y)[m_Stride - 1] &= ~0ull >> (64 - (m_Width & 63));
+        return *this;
+    }
+
+    size_t Count() const
+    {
+        size_t count = 0;
+        for (uint64_t word : m_Words)
+            count += PopCount(word);
+        return count;
+    }
+
+    /* Apply to render target of the same size, full words write 64 cells without looking at bits */
+public:
+    void ApplyFill(RenderTarget& Target, short Character, short Color) const
+    {
+        Pixel pixel;
+        pixel.Char.UnicodeChar = Character;
+        pixel.Attributes = Color;
+        ForEachSpan([&](int x, int y, int Length)
+        {
+            std::fill_n(Target.Row(y) + x, Length, pixel);
+            Target.CountWrites(Target.Row(y) + x, Length);
+        });
+    }
+    void ApplyRecolor(RenderTarget& Target, short Color) const
+    {
+        ForEachSpan([&](int x, int y, int Length)
+        {
+            Pixel* cells = Target.Row(y) + x;
+            for (int i = 0; i < Length; ++i)
+                cells[i].Attributes = Color;
+            Target.CountWrites(cells, Length);
+        });
+    }
+
+    ///<summary> Call Func(x, y, Length) for every run of set bits inside one word </summary>
+    template < typename SpanFunc >
+    void ForEachSpan(SpanFunc&& Func) const
+    {
+        assert(m_Width > 0 || m_Words.empty());
+        for (int y = 0; y < m_Height; ++y)
+        {
+            const uint64_t* row = Row(y);
+            for (int w = 0; w < m_Stride; ++w)
+            {
+                uint64_t bits = row[w];
+                if (bits == ~0ull)
+                {
+                    Func(w * 64, y, 64);
+                    continue;
+                }
+                while (bits)
+                {
+                    int start = TrailingZeros(bits);
+                    uint64_t rest = bits >> start;
+                    int length = ~rest ? TrailingZeros(~rest) : 64 - start;
+                    Func(w * 64 + start, y, length);
+                    bits &= length + start >= 64 ? 0 : ~0ull << (start + length);
+                }
+            }
+        }
+    }
+
+private:
+    uint64_t* Row(int y) { return m_Words.data() + (size_t)y * m_Stride; }
+    const uint64_t* Row(int y) const { return m_Words.data() + (size_t)y * m_Stride; }
+    bool SameSize(const CellMask& Other) const { return m_Width == Other.m_Width && m_Height == Other.m_Height; }
+
+    static int TrailingZeros(uint64_t Bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, Bits);
+        return (int)index;
+#else
+        return __builtin_ctzll(Bits);
+#endif
+    }
+    static int PopCount(uint64_t Bits)
+    {
+#ifdef _MSC_VER
+        return (int)__popcnt64(Bits);
+#else
+        return __builtin_popcountll(Bits);
+#endif
+    }
+
+    std::vector<uint64_t> m_Words;
+    int m_Width = 0, m_Height = 0;
+    int m_Stride = 0;       // Words per row
+};
+
+/* Scanline flood fill, keeps its stack between calls */
+class FloodFiller
+{
+public:
+    ///<summary> Mark region 4-connected to (x,y) with cells matching the seed, bounded by clip rect </summary>
+    ///<returns> Count of selected cells </returns>
+    size_t Select(const RenderTarget& Target, int x, int y, FILL_MATCH Match, CellMask& Out)
+    {
+        Out.Resize(Target.Width(), Target.Height());
+        const ClipRect& clip = Target.Clip();
+        if (!clip.Contains(x, y))
+            return 0;
+
+        const uint32_t mask = MatchMask(Match);
+        const uint32_t seed = Key(Target.Row(y)[x]) & mask;
+        auto inside = [&](const Pixel* Row, int cx, int cy)
+        {
+            return (Key(Row[cx]) & mask) == seed && !Out.Test(cx, cy);
+        };
+
+        size_t count = 0;
+        m_Stack.clear();
+        m_Stack.push_back({ x, y });
+        while (!m_Stack.empty())
+        {
+            Seed current = m_Stack.back();
+            m_Stack.pop_back();
+            const Pixel* row = Target.Row(current.y);
+            if (!inside(row, current.x, current.y))
+                continue;
+
+            // Extend to the whole run of the row, then mark it at once
+            int left = current.x, right = current.x + 1;
+            while (left > clip.Left && inside(row, left - 1, current.y))
+                --left;
+            while (right < clip.Right && inside(row, right, current.y))
+                ++right;
+            Out.SetSpan(current.y, left, right);
+            count += right - left;
+
+            // One seed per run of matching cells above and below
+            for (int ny = current.y - 1; ny <= current.y + 1; ny += 2)
+            {
+                if (ny < clip.Top || ny >= clip.Bottom)
+                    continue;
+                const Pixel* next = Target.Row(ny);
+                bool in_run = false;
+                for (int nx = left; nx < right; ++nx)
+                {
+                    bool match = inside(next, nx, ny);
+                    if (match && !in_run)
+                        m_Stack.push_back({ nx, ny });
+                    in_run = match;
+                }
+            }
+        }
+        return count;
+    }
+
+    ///<summary> Fill region connected to (x,y) with Character and Color </summary>
+    size_t Fill(RenderTarget& Target, int x, int y, short Character, short Color, FILL_MATCH Match = FILL_MATCH::BOTH)
+    {
+        size_t count = Select(Target, x, y, Match, m_Mask);
+        m_Mask.ApplyFill(Target, Character, Color);
+        return count;
+    }
+
+    // Region selected by the last Fill() call
+    const CellMask& LastMask() const { return m_Mask; }
+
+private:
+    struct Seed
+    {
+        int x, y;
+    };
+
+    // Pixel as one word, character in the low half and attributes in the high half
+    static uint32_t Key(const Pixel& Cell)
+    {
+        return (uint32_t)(uint16_t)Cell.Char.UnicodeChar | ((uint32_t)(uint16_t)Cell.Attributes << 16);
+    }
+    static uint32_t MatchMask(FILL_MATCH Match)
+    {
+        switch (Match)
+        {
+        case FILL_MATCH::GLYPH: return 0x0000FFFF;
+        case FILL_MATCH::ATTRIBUTE: return 0xFFFF0000;
+        default: return 0xFFFFFFFF;
+        }
+    }
+
+    std::vector<Seed> m_Stack;
+    CellMask m_Mask;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#define CE_FRAME_ARENA_BLOCK_SIZE (256 * 1024)
+
+/* Bump allocator for memory that lives until the end of frame */
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t BlockSize = CE_FRAME_ARENA_BLOCK_SIZE) : m_BlockSize(BlockSize) {}
+    ~FrameArena()
+    {
+        for (auto& block : m_Blocks)
+            delete[] block.Data;
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t Size, size_t Align = alignof(max_align_t))
+    {
+        assert((Align & (Align - 1)) == 0 && "Alignment must be power of two");
+        if (!m_Blocks.empty())
+        {
+            Block& block = m_Blocks[m_BlockIndex];
+            size_t offset = AlignOffset(block.Data, m_Offset, Align);
+            if (offset + Size <= block.Size)
+            {
+                m_Offset = offset + Size;
+                return block.Data + offset;
+            }
+        }
+        return AllocateFromNextBlock(Size, Align);
+    }
+
+    ///<summary> Value-initialized array, destructors are never called </summary>
+    template < typename T >
+    T* AllocateArray(size_t Count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never calls destructors");
+        T* result = static_cast<T*>(Allocate(sizeof(T) * Count, alignof(T)));
+        for (size_t i = 0; i < Count; ++i)
+            new (result + i) T();
+        return result;
+    }
+
+    ///<summary> Free everything allocated since the last reset, memory is kept for the next frame </summary>
+    void Reset()
+    {
+        // Frame that overflowed to several blocks merges them into one, so steady frames don't chain
+        if (m_Blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (auto& block : m_Blocks)
+            {
+                total += block.Size;
+                delete[] block.Data;
+            }
+            m_Blocks.clear();
+            m_Blocks.push_back({ new uint8_t[total], total });
+        }
+        m_BlockIndex = 0;
+        m_Offset = 0;
+    }
+
+    // Bytes used by the current frame, only exact while the frame fits one block
+    size_t Used() const { return m_Offset; }
+    size_t Capacity() const
+    {
+        size_t total = 0;
+        for (auto& block : m_Blocks)
+            total += block.Size;
+        return total;
+    }
+
+private:
+    struct Block
+    {
+        uint8_t* Data;
+        size_t Size;
+    };
+
+    void* AllocateFromNextBlock(size_t Size, size_t Align)
+    {
+        // Blocks after current one exist only between Reset() calls, so it's always a new block
+        size_t size = Size + Align > m_BlockSize ? Size + Align : m_BlockSize;
+        m_Blocks.push_back({ new uint8_t[size], size });
+        m_BlockIndex = m_Blocks.size() - 1;
+
+        size_t offset = AlignOffset(m_Blocks.back().Data, 0, Align);
+        m_Offset = offset + Size;
+        return m_Blocks.back().Data + offset;
+    }
+
+    static size_t AlignOffset(const uint8_t* Base, size_t Offset, size_t Align)
+    {
+        uintptr_t address = (uintptr_t)(Base + Offset);
+        return Offset + (size_t)(((address + Align - 1) & ~(uintptr_t)(Align - 1)) - address);
+    }
+
+    size_t m_BlockSize;
+    std::vector<Block> m_Blocks;
+    size_t m_BlockIndex = 0;
+    size_t m_Offset = 0;
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+// Winsock 2 conflicts with winsock 1 pulled by Windows.h, so include this header before ConsoleEngine.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+#include <stf/ConsoleEngine.h>
+
+#define CE_STREAM_DEFAULT_PORT 27015
+#define CE_STREAM_KEYFRAME_INTERVAL 120     // Frames between forced keyframes for every client
+#define CE_STREAM_SEND_BUFFER (64 * 1024)  // Small socket buffer makes slow viewers skip frames instead of lagging behind
+#define CE_STREAM_MAGIC 0x53464543          // "CEFS"
+
+// Packet kinds of the frame stream
+enum class STREAM_FRAME : uint8_t
+{
+    KEY = 0,        // Payload is Width * Height cells
+    DELTA = 1       // Payload is rows: StreamRowHeader followed by Count cells
+};
+
+#pragma pack(push, 1)
+struct StreamFrameHeader
+{
+    uint32_t Magic;
+    uint32_t FrameIndex;
+    uint16_t Width;
+    uint16_t Height;
+    STREAM_FRAME Type;
+    uint32_t PayloadSize;
+};
+
+// Changed part of the row: cells [Start, Start + Count)
+struct StreamRowHeader
+{
+    uint16_t Row;
+    uint16_t Start;
+    uint16_t Count;
+};
+#pragma pack(pop)
+
+/* Frame encoding shared by server and viewer */
+class FrameCodec
+{
+public:
+    ///<summary> Encode frame as keyframe, or as changed row spans when Previous has the same size </summary>
+    ///<returns> False if delta is empty and nothing has to be sent </returns>
+    static bool Encode(const Pixel* Current, const Pixel* Previous, int Width, int Height, uint32_t FrameIndex, std::vector<uint8_t>& Out)
+    {
+        Out.resize(sizeof(StreamFrameHeader));
+        StreamFrameHeader header = { CE_STREAM_MAGIC, FrameIndex, (uint16_t)Width, (uint16_t)Height, STREAM_FRAME::KEY, 0 };
+
+        if (!Previous)
+        {
+            Append(Out, Current, sizeof(Pixel) * Width * Height);
+        }
+        else
+        {
+            header.Type = STREAM_FRAME::DELTA;
+            for (int y = 0; y < Height; ++y)
+            {
+                const Pixel* now = Current + (size_t)y * Width;
+                const Pixel* was = Previous + (size_t)y * Width;
+                int first = 0, last = Width - 1;
+                while (first < Width && SameCell(now[first], was[first]))
+                    ++first;
+                if (first == Width)
+                    continue;
+                while (SameCell(now[last], was[last]))
+                    --last;
+
+                StreamRowHeader row = { (uint16_t)y, (uint16_t)first, (uint16_t)(last - first + 1) };
+                Append(Out, &row, sizeof(row));
+                Append(Out, now + first, sizeof(Pixel) * row.Count);
+            }
+            if (Out.size() == sizeof(StreamFrameHeader))
+                return false;
+        }
+
+        header.PayloadSize = (uint32_t)(Out.size() - sizeof(StreamFrameHeader));
+        memcpy(Out.data(), &header, sizeof(header));
+        return true;
+    }
+
+    ///<summary> Apply payload to Frame, keyframe resizes it </summary>
+    ///<returns> False on malformed payload </returns>
+    static bool Decode(const StreamFrameHeader& Header, const uint8_t* Payload, std::vector<Pixel>& Frame, int& Width, int& Height)
+    {
+        if (Header.Type == STREAM_FRAME::KEY)
+        {
+            if (Header.PayloadSize != sizeof(Pixel) * Header.Width * Header.Height)
+                return false;
+            Width = Header.Width;
+            Height = Header.Height;
+            Frame.resize((size_t)Width * Height);
+            memcpy(Frame.data(), Payload, Header.PayloadSize);
+            return true;
+        }
+
+        // Delta for the other size means we missed a keyframe
+        if (Header.Width != Width || Header.Height != Height)
+            return false;
+
+        const uint8_t* end = Payload + Header.PayloadSize;
+        while (Payload + sizeof(StreamRowHeader) <= end)
+        {
+            StreamRowHeader row;
+            memcpy(&row, Payload, sizeof(row));
+            Payload += sizeof(row);
+            if (row.Row >= Height || row.Start + row.Count > Width || Payload + sizeof(Pixel) * row.Count > end)
+                return false;
+            memcpy(Frame.data() + (size_t)row.Row * Width + row.Start, Payload, sizeof(Pixel) * row.Count);
+            Payload += sizeof(Pixel) * row.Count;
+        }
+        return Payload == end;
+    }
+
+private:
+    static bool SameCell(const Pixel& a, const Pixel& b)
+    {
+        return a.Char.UnicodeChar == b.Char.UnicodeChar && a.Attributes == b.Attributes;
+    }
+
+    static void Append(std::vector<uint8_t>& Out, const void* Data, size_t Size)
+    {
+        size_t offset = Out.size();
+        Out.resize(offset + Size);
+        memcpy(Out.data() + offset, Data, Size);
+    }
+};
+
+///<summary> Loopback TCP server that streams presented frames to any number of viewers </summary>
+///<remarks> Publish() only copies the frame under a lock, every client has own sender thread that
+/// always takes the newest frame, so slow clients skip frames instead of stalling the engine.
+/// Usually called from ConsoleEngine::OnPresent(). </remarks>
+class FrameStreamServer
+{
+public:
+    FrameStreamServer() = default;
+    ~FrameStreamServer() { Stop(); }
+
+    FrameStreamServer(const FrameStreamServer&) = delete;
+    FrameStreamServer& operator=(const FrameStreamServer&) = delete;
+
+    bool Start(unsigned short Port = CE_STREAM_DEFAULT_PORT)
+    {
+        if (m_Running)
+            return true;
+
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+            return false;
+
+        m_Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_Listener == INVALID_SOCKET)
+        {
+            WSACleanup();
+            return false;
+        }
+
+        // Only local viewers
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(Port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(m_Listener, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(m_Listener, SOMAXCONN) == SOCKET_ERROR)
+        {
+            closesocket(m_Listener);
+            m_Listener = INVALID_SOCKET;
+            WSACleanup();
+            return false;
+        }
+
+        m_Running = true;
+        m_AcceptThread = std::thread(&FrameStreamServer::AcceptThread, this);
+        return true;
+    }
+
+    void Stop()
+    {
+        if (!m_Running)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_FrameMutex);
+            m_Running = false;
+        }
+        m_FrameCondition.notify_all();
+
+        // Closing sockets unblocks accept() and send() calls
+        closesocket(m_Listener);
+        m_Listener = INVALID_SOCKET;
+        m_AcceptThread.join();
+
+        std::lock_guard<std::mutex> lock(m_ClientsMutex);
+        for (auto& client : m_Clients)
+        {
+            shutdown(client->Socket, SD_BOTH);
+            closesocket(client->Socket);
+            client->Thread.join();
+        }
+        m_Clients.clear();
+        WSACleanup();
+    }
+
+    // Copy frame for senders, never waits for the network
+    void Publish(const Pixel* Buffer, int Width, int Height)
+    {
+        if (!m_Running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_FrameMutex);
+            m_Frame.resize((size_t)Width * Height);
+            memcpy(m_Frame.data(), Buffer, sizeof(Pixel) * Width * Height);
+            m_Width = Width;
+            m_Height = Height;
+            ++m_FrameIndex;
+        }
+        m_FrameCondition.notify_all();
+    }
+
+    size_t ClientCount()
+    {
+        std::lock_guard<std::mutex> lock(m_ClientsMutex);
+        size_t count = 0;
+        for (auto& client : m_Clients)
+            count += client->Alive ? 1 : 0;
+        return count;
+    }
+
+private:
+    struct Client
+    {
+        SOCKET Socket = INVALID_SOCKET;
+        std::thread Thread;
+        std::atomic<bool> Alive{ true };
+    };
+
+    void AcceptThread()
+    {
+        while (m_Running)
+        {
+            SOCKET socket = accept(m_Listener, NULL, NULL);
+            if (socket == INVALID_SOCKET)
+            {
+                // Stop() closed the listener, otherwise wait a bit, so a failing accept() doesn't spin a core
+                if (m_Running)
+                    WaitFor(10ms);
+                continue;
+            }
+
+            BOOL no_delay = TRUE;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+            int send_buffer = CE_STREAM_SEND_BUFFER;
+            setsockopt(socket, SOL_SOCKET, SO_SNDBUF, (const char*)&send_buffer, sizeof(send_buffer));
+
+            std::lock_guard<std::mutex> lock(m_ClientsMutex);
+            // Reap disconnected clients before adding the new one
+            for (size_t i = 0; i < m_Clients.size();)
+            {
+                if (m_Clients[i]->Alive)
+                {
+                    ++i;
+                    continue;
+                }
+                m_Clients[i]->Thread.join();
+                closesocket(m_Clients[i]->Socket);
+                m_Clients.erase(m_Clients.begin() + i);
+            }
+            m_Clients.emplace_back(new Client);
+            Client* client = m_Clients.back().get();
+            client->Socket = socket;
+            client->Thread = std::thread(&FrameStreamServer::ClientThread, this, client);
+        }
+    }
+
+    void ClientThread(Client* Target)
+    {
+        std::vector<Pixel> current, sent;
+        std::vector<uint8_t> packet;
+        int width = 0, height = 0;
+        int sent_width = 0, sent_height = 0;
+        uint64_t sent_index = 0;
+        uint32_t since_keyframe = 0;
+
+        while (true)
+        {
+            {
+                // Take only the newest frame, frames published meanwhile are dropped for this client
+                std::unique_lock<std::mutex> lock(m_FrameMutex);
+                m_FrameCondition.wait(lock, [&] { return !m_Running || m_FrameIndex != sent_index; });
+                if (!m_Running)
+                    break;
+                current.assign(m_Frame.begin(), m_Frame.end());
+                width = m_Width;
+                height = m_Height;
+                sent_index = m_FrameIndex;
+            }
+
+            bool keyframe = sent.empty() || width != sent_width || height != sent_height || since_keyframe >= CE_STREAM_KEYFRAME_INTERVAL;
+            if (FrameCodec::Encode(current.data(), keyframe ? nullptr : sent.data(), width, height, (uint32_t)sent_index, packet))
+            {
+                if (!SendAll(Target->Socket, packet.data(), packet.size()))
+                    break;
+                since_keyframe = keyframe ? 0 : since_keyframe + 1;
+            }
+            sent.swap(current);
+            sent_width = width;
+            sent_height = height;
+        }
+        Target->Alive = false;
+    }
+
+    static bool SendAll(SOCKET Socket, const uint8_t* Data, size_t Size)
+    {
+        while (Size > 0)
+        {
+            int sent = send(Socket, (const char*)Data, (int)std::min<size_t>(Size, 1 << 20), 0);
+            if (sent == SOCKET_ERROR || sent == 0)
+                return false;
+            Data += sent;
+            Size -= sent;
+        }
+        return true;
+    }
+
+    std::atomic<bool> m_Running{ false };
+    SOCKET m_Listener = INVALID_SOCKET;
+    std::thread m_AcceptThread;
+
+    std::mutex m_ClientsMutex;
+    std::vector<std::unique_ptr<Client>> m_Clients;
+
+    std::mutex m_FrameMutex;
+    std::condition_variable m_FrameCondition;
+    std::vector<Pixel> m_Frame;
+    int m_Width = 0, m_Height = 0;
+    uint64_t m_FrameIndex = 0;
+};
+
+///<summary> Console app that shows frames of FrameStreamServer running in another process </summary>
+///<remarks> int main() { StreamViewer viewer; if (viewer.ConstructConsole(120, 40, 8, 16)) viewer.Start(); } </remarks>
+class StreamViewer : public ConsoleEngine
+{
+public:
+    explicit StreamViewer(unsigned short Port = CE_STREAM_DEFAULT_PORT) : m_Port(Port) {}
+
+protected:
+    void Init() override
+    {
+        SetAppName(L"Stream Viewer");
+        WSADATA wsa;
+        m_NetworkReady = WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+        m_Receiving = true;
+        m_ReceiveThread = std::thread(&StreamViewer::ReceiveThread, this);
+    }
+
+    void Update() override
+    {
+        if (GetKey(KEY::ESC).Pressed)
+            Quit();
+
+        std::lock_guard<std::mutex> lock(m_FrameMutex);
+        if (m_Frame.empty())
+        {
+            DrawRect(0, 0, ScreenWidth(), ScreenHeight(), L' ', FG_BLACK);
+            DrawString(1, 1, m_Connected ? L"Waiting for keyframe..." : L"Connecting...", FG_GREY);
+            return;
+        }
+        DrawScreenBuffer(0, 0, m_Width, m_Height, m_Frame.data());
+    }
+
+    void Destroy() override
+    {
+        m_Receiving = false;
+        if (m_Socket != INVALID_SOCKET)
+            shutdown(m_Socket, SD_BOTH);
+        m_ReceiveThread.join();
+        if (m_NetworkReady)
+            WSACleanup();
+        ConsoleEngine::Destroy();
+    }
+
+private:
+    void ReceiveThread()
+    {
+        std::vector<uint8_t> payload;
+        while (m_Receiving && m_NetworkReady)
+        {
+            if (!Connect())
+            {
+                WaitFor(500ms);
+                continue;
+            }
+
+            StreamFrameHeader header;
+            while (m_Receiving && ReceiveAll(m_Socket, (uint8_t*)&header, sizeof(header)) && header.Magic == CE_STREAM_MAGIC)
+            {
+                payload.resize(header.PayloadSize);
+                if (!ReceiveAll(m_Socket, payload.data(), payload.size()))
+                    break;
+
+                std::lock_guard<std::mutex> lock(m_FrameMutex);
+                if (!FrameCodec::Decode(header, payload.data(), m_Frame, m_Width, m_Height))
+                    break;
+            }
+
+            // Reconnect from scratch, the server starts every client with a keyframe
+            std::lock_guard<std::mutex> lock(m_FrameMutex);
+            closesocket(m_Socket);
+            m_Socket = INVALID_SOCKET;
+            m_Connected = false;
+            m_Frame.clear();
+        }
+    }
+
+    bool Connect()
+    {
+        SOCKET socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (socket == INVALID_SOCKET)
+            return false;
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(m_Port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(socket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+        {
+            closesocket(socket);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_FrameMutex);
+        m_Socket = socket;
+        m_Connected = true;
+        return true;
+    }
+
+    static bool ReceiveAll(SOCKET Socket, uint8_t* Data, size_t Size)
+    {
+        while (Size > 0)
+        {
+            int received = recv(Socket, (char*)Data, (int)std::min<size_t>(Size, 1 << 20), 0);
+            if (received == SOCKET_ERROR || received == 0)
+                return false;
+            Data += received;
+            Size -= received;
+        }
+        return true;
+    }
+
+    unsigned short m_Port;
+    bool m_NetworkReady = false;
+    std::atomic<bool> m_Receiving{ false };
+    std::thread m_ReceiveThread;
+    SOCKET m_Socket = INVALID_SOCKET;
+
+    std::mutex m_FrameMutex;
+    std::vector<Pixel> m_Frame;
+    int m_Width = 0, m_Height = 0;
+    bool m_Connected = false;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <stdio.h>
+
+// Write counts of a render target during one frame
+struct OverdrawStats
+{
+    uint64_t Writes = 0;        // Cell writes of all calls, a cell written twice counts twice
+    size_t Touched = 0;         // Cells written at least once
+    uint16_t MaxWrites = 0;     // Most writes of a single cell
+
+    // Average writes of a touched cell, 1.0 means nothing is drawn twice
+    double Overdraw() const { return Touched ? (double)Writes / Touched : 0.0; }
+};
+
+#ifdef CE_OVERDRAW
+/* Heatmap of per cell write counts, see CE_OVERDRAW in RenderTarget.h */
+class OverdrawOverlay
+{
+public:
+    static OverdrawStats Measure(const RenderTarget& Target)
+    {
+        OverdrawStats stats;
+        const uint16_t* counts = Target.WriteCounts();
+        const size_t size = (size_t)Target.Width() * Target.Height();
+        for (size_t i = 0; i < size; ++i)
+        {
+            stats.Touched += counts[i] != 0;
+            stats.MaxWrites = std::max(stats.MaxWrites, counts[i]);
+        }
+        stats.Writes = Target.WriteTotal();
+        return stats;
+    }
+
+    ///<summary> Replace cells of Target by heatmap of its counts, digit is count and background is heat </summary>
+    ///<remarks> Overlay writes are not counted, top row shows totals of the frame </remarks>
+    static void Draw(RenderTarget& Target, const OverdrawStats& Stats)
+    {
+        const uint16_t* counts = Target.WriteCounts();
+        for (int y = 0; y < Target.Height(); ++y)
+        {
+            Pixel* row = Target.Row(y);
+            const uint16_t* row_counts = counts + (size_t)y * Target.Width();
+            for (int x = 0; x < Target.Width(); ++x)
+                row[x] = Cell(row_counts[x]);
+        }
+
+        char text[128];
+        int length = snprintf(text, sizeof(text), " writes %llu  touched %zu  overdraw %.2fx  max %u ",
+            (unsigned long long)Stats.Writes, Stats.Touched, Stats.Overdraw(), (unsigned)Stats.MaxWrites);
+        length = std::min(length, Target.Width());
+        Pixel* top = Target.Row(0);
+        for (int i = 0; i < length; ++i)
+        {
+            top[i].Char.UnicodeChar = (unsigned char)text[i];
+            top[i].Attributes = 0x000F;
+        }
+    }
+
+private:
+    // Untouched cells are dark, then blue, green, yellow, red for 4-7 and magenta for 8 and more writes
+    static Pixel Cell(uint16_t Count)
+    {
+        static const uint16_t heat[] = { 0x0008, 0x001F, 0x002F, 0x0060, 0x00CF, 0x00DF };
+        Pixel pixel;
+        pixel.Char.UnicodeChar = Count == 0 ? L'.' : Count < 10 ? L'0' + Count : L'+';
+        pixel.Attributes = heat[Count < 4 ? Count : Count < 8 ? 4 : 5];
+        return pixel;
+    }
+};
+#endif
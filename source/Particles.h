@@ -0,0 +1,227 @@
+#pragma once
+
+#include <stf/ConsoleEngine.h>
+
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#define CE_PARTICLES_DEFAULT_CAPACITY 65536
+
+// Settings of particles source, all distances in cells and times in seconds
+struct ParticleEmitter
+{
+    float X = 0.0f, Y = 0.0f;           // Spawn point
+    float Radius = 0.0f;                // Particles spawn in the square of this half size around the point
+    float Angle = 0.0f;                 // Direction of emission in radians
+    float Spread = (float)TWO_PI;       // Angle range around Angle
+    float SpeedMin = 5.0f, SpeedMax = 10.0f;
+    float LifeMin = 0.5f, LifeMax = 1.0f;
+    float Rate = 100.0f;                // Particles per second, zero to only emit with Burst()
+    short Character = QUAD::SOLID;
+    short Color = FG_WHITE;
+    bool Active = true;
+};
+
+/* Particles stored as separate arrays of positions, velocities and lifetimes */
+class ParticleSystem
+{
+public:
+    explicit ParticleSystem(size_t Capacity = CE_PARTICLES_DEFAULT_CAPACITY)
+    {
+        // Round up to SIMD width, so the last group of four never reads out of arrays
+        m_Capacity = Capacity;
+        size_t padded = (Capacity + 3) & ~(size_t)3;
+        m_X.resize(padded); m_Y.resize(padded);
+        m_VX.resize(padded); m_VY.resize(padded);
+        m_Life.resize(padded);
+        m_Character.resize(padded); m_Color.resize(padded);
+        m_CellX.resize(padded); m_CellY.resize(padded);
+    }
+
+    /* Emitters */
+public:
+    size_t AddEmitter(const ParticleEmitter& Emitter)
+    {
+        m_Emitters.push_back(Emitter);
+        m_EmitCarry.push_back(0.0f);
+        return m_Emitters.size() - 1;
+    }
+    ParticleEmitter& GetEmitter(size_t Index) { return m_Emitters[Index]; }
+    size_t EmitterCount() const { return m_Emitters.size(); }
+    void ClearEmitters()
+    {
+        m_Emitters.clear();
+        m_EmitCarry.clear();
+    }
+
+    // Spawn particles at once, extra particles are dropped when system is full
+    void Burst(const ParticleEmitter& Emitter, size_t Count)
+    {
+        if (Count > m_Capacity - m_Count)
+            Count = m_Capacity - m_Count;
+        for (size_t i = m_Count; i < m_Count + Count; ++i)
+        {
+            float angle = Emitter.Angle + (RandomFloat() - 0.5f) * Emitter.Spread;
+            float speed = Emitter.SpeedMin + RandomFloat() * (Emitter.SpeedMax - Emitter.SpeedMin);
+            m_X[i] = Emitter.X + (RandomFloat() * 2.0f - 1.0f) * Emitter.Radius;
+            m_Y[i] = Emitter.Y + (RandomFloat() * 2.0f - 1.0f) * Emitter.Radius;
+            m_VX[i] = cosf(angle) * speed;
+            m_VY[i] = sinf(angle) * speed;
+            m_Life[i] = Emitter.LifeMin + RandomFloat() * (Emitter.LifeMax - Emitter.LifeMin);
+            m_Character[i] = Emitter.Character;
+            m_Color[i] = Emitter.Color;
+        }
+        m_Count += Count;
+    }
+
+    /* Simulation */
+public:
+    // Constant acceleration applied to every particle, e.g. { 0, 9.8 } for falling sparks
+    void SetGravity(float x, float y) { m_GravityX = x; m_GravityY = y; }
+    // Fraction of velocity lost per second
+    void SetDrag(float Drag) { m_Drag = Drag; }
+
+    void Update(float DeltaTime)
+    {
+        auto tpBegin = std::chrono::steady_clock::now();
+
+        for (size_t e = 0; e < m_Emitters.size(); ++e)
+        {
+            if (!m_Emitters[e].Active)
+                continue;
+            m_EmitCarry[e] += m_Emitters[e].Rate * DeltaTime;
+            size_t spawn = (size_t)m_EmitCarry[e];
+            m_EmitCarry[e] -= (float)spawn;
+            Burst(m_Emitters[e], spawn);
+        }
+
+        size_t processed = m_Count;
+        Integrate(DeltaTime);
+        RemoveDead();
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count();
+        if (elapsed > 0.0)
+            m_ParticlesPerSecond = processed / elapsed;
+    }
+
+    // Convert positions to cells and draw them with one clipped batch
+    void Draw(ConsoleEngine& Engine)
+    {
+        size_t i = 0;
+#ifdef CE_SIMD_SSE2
+        const __m128 one = _mm_set1_ps(1.0f);
+        for (; i < m_Count; i += 4)
+        {
+            _mm_storeu_si128((__m128i*)(m_CellX.data() + i), Floor(_mm_loadu_ps(m_X.data() + i), one));
+            _mm_storeu_si128((__m128i*)(m_CellY.data() + i), Floor(_mm_loadu_ps(m_Y.data() + i), one));
+        }
+#else
+        for (; i < m_Count; ++i)
+        {
+            m_CellX[i] = (int)floorf(m_X[i]);
+            m_CellY[i] = (int)floorf(m_Y[i]);
+        }
+#endif
+        Engine.DrawPixels(m_CellX.data(), m_CellY.data(), m_Count, m_Character.data(), m_Color.data());
+    }
+
+    void Clear() { m_Count = 0; }
+
+    size_t Count() const { return m_Count; }
+    size_t Capacity() const { return m_Capacity; }
+
+    // Throughput of the last Update() call
+    double ParticlesPerSecond() const { return m_ParticlesPerSecond; }
+
+private:
+    void Integrate(float DeltaTime)
+    {
+        const float damping = m_Drag * DeltaTime < 1.0f ? 1.0f - m_Drag * DeltaTime : 0.0f;
+        const float gravity_x = m_GravityX * DeltaTime;
+        const float gravity_y = m_GravityY * DeltaTime;
+
+        size_t i = 0;
+#ifdef CE_SIMD_SSE2
+        const __m128 dt4 = _mm_set1_ps(DeltaTime);
+        const __m128 damping4 = _mm_set1_ps(damping);
+        const __m128 gx4 = _mm_set1_ps(gravity_x);
+        const __m128 gy4 = _mm_set1_ps(gravity_y);
+        for (; i < m_Count; i += 4)
+        {
+            __m128 vx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m_VX.data() + i), damping4), gx4);
+            __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m_VY.data() + i), damping4), gy4);
+            _mm_storeu_ps(m_VX.data() + i, vx);
+            _mm_storeu_ps(m_VY.data() + i, vy);
+            _mm_storeu_ps(m_X.data() + i, _mm_add_ps(_mm_loadu_ps(m_X.data() + i), _mm_mul_ps(vx, dt4)));
+            _mm_storeu_ps(m_Y.data() + i, _mm_add_ps(_mm_loadu_ps(m_Y.data() + i), _mm_mul_ps(vy, dt4)));
+            _mm_storeu_ps(m_Life.data() + i, _mm_sub_ps(_mm_loadu_ps(m_Life.data() + i), dt4));
+        }
+#else
+        for (; i < m_Count; ++i)
+        {
+            m_VX[i] = m_VX[i] * damping + gravity_x;
+            m_VY[i] = m_VY[i] * damping + gravity_y;
+            m_X[i] += m_VX[i] * DeltaTime;
+            m_Y[i] += m_VY[i] * DeltaTime;
+            m_Life[i] -= DeltaTime;
+        }
+#endif
+    }
+
+    // Move the last alive particle into place of every dead one
+    void RemoveDead()
+    {
+        size_t i = 0;
+        while (i < m_Count)
+        {
+            if (m_Life[i] > 0.0f)
+            {
+                ++i;
+                continue;
+            }
+            size_t last = --m_Count;
+            m_X[i] = m_X[last]; m_Y[i] = m_Y[last];
+            m_VX[i] = m_VX[last]; m_VY[i] = m_VY[last];
+            m_Life[i] = m_Life[last];
+            m_Character[i] = m_Character[last]; m_Color[i] = m_Color[last];
+        }
+    }
+
+#ifdef CE_SIMD_SSE2
+    // SSE2 has no floor, truncate and step down where truncation rounded up
+    static __m128i Floor(__m128 Value, __m128 One)
+    {
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(Value));
+        __m128 floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, Value), One));
+        return _mm_cvttps_epi32(floored);
+    }
+#endif
+
+    // xorshift32, enough for visual randomness and much cheaper than rand()
+    float RandomFloat()
+    {
+        m_Seed ^= m_Seed << 13;
+        m_Seed ^= m_Seed >> 17;
+        m_Seed ^= m_Seed << 5;
+        return (m_Seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    size_t m_Count = 0;
+    size_t m_Capacity = 0;
+
+    std::vector<float> m_X, m_Y;
+    std::vector<float> m_VX, m_VY;
+    std::vector<float> m_Life;
+    std::vector<short> m_Character, m_Color;
+    std::vector<int> m_CellX, m_CellY;      // Draw scratch
+
+    std::vector<ParticleEmitter> m_Emitters;
+    std::vector<float> m_EmitCarry;         // Fractional particles left from previous frames
+
+    float m_GravityX = 0.0f, m_GravityY = 0.0f;
+    float m_Drag = 0.0f;
+
+    uint32_t m_Seed = 0x9E3779B9u;
+    double m_ParticlesPerSecond = 0.0;
+};
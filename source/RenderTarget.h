@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#ifdef CE_OVERDRAW
+#include <atomic>
+#endif
+
+// SSE2 is always available on x64, define CE_NO_SIMD to use plain loops
+#if !defined(CE_NO_SIMD) && (defined(_M_X64) || defined(__SSE2__))
+#define CE_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// #define CE_OVERDRAW // Uncomment this to count writes of every cell, see Overdraw.h. Without it counting compiles to nothing
+
+// Screen buffer pixel data, on other platforms the same layout without Windows.h
+#if defined(_WIN32) || defined(_WINDOWS_)
+#include <Windows.h>
+typedef CHAR_INFO Pixel;
+#else
+struct Pixel
+{
+    union
+    {
+        uint16_t UnicodeChar;
+        char AsciiChar;
+    } Char;
+    uint16_t Attributes;
+};
+#endif
+static_assert(sizeof(Pixel) == 4, "Pixel must be 16 bit character and 16 bit attributes");
+
+// Cells [Left, Right) x [Top, Bottom)
+struct ClipRect
+{
+    int Left = 0, Top = 0, Right = 0, Bottom = 0;
+
+    bool Contains(int x, int y) const { return x >= Left && x < Right && y >= Top && y < Bottom; }
+    bool Empty() const { return Left >= Right || Top >= Bottom; }
+};
+
+/* Buffer of pixels that engine can draw to instead of the screen */
+class RenderTarget
+{
+public:
+    RenderTarget() = default;
+    RenderTarget(int Width, int Height) { Resize(Width, Height); }
+
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    // Own memory of Width x Height pixels, contents are cleared and clip is reset
+    void Resize(int Width, int Height)
+    {
+        m_Storage.assign((size_t)Width * Height, Pixel{});
+        m_Buffer = m_Storage.data();
+        m_Width = Width;
+        m_Height = Height;
+        ResetClip();
+#ifdef CE_OVERDRAW
+        OwnWriteCounts();
+#endif
+    }
+
+    // Draw to memory owned by someone else, e.g. the screen buffer
+    void Attach(Pixel* Buffer, int Width, int Height)
+    {
+        m_Storage.clear();
+        m_Buffer = Buffer;
+        m_Width = Width;
+        m_Height = Height;
+        ResetClip();
+#ifdef CE_OVERDRAW
+        OwnWriteCounts();
+#endif
+    }
+
+    ///<summary> Draw to pixels of Parent through own clip rect, e.g. from threads that draw different rows </summary>
+    ///<remarks> Writes are counted in Parent. View is valid while Parent keeps its buffer </remarks>
+    void AttachView(RenderTarget& Parent)
+    {
+        m_Storage.clear();
+        m_Buffer = Parent.m_Buffer;
+        m_Width = Parent.m_Width;
+        m_Height = Parent.m_Height;
+        ResetClip();
+#ifdef CE_OVERDRAW
+        m_WriteCounts.clear();
+        m_Counts = Parent.m_Counts;
+        m_Total = Parent.m_Total;
+#endif
+    }
+
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+    Pixel* Data() { return m_Buffer; }
+    const Pixel* Data() const { return m_Buffer; }
+    Pixel* Row(int y) { return m_Buffer + (size_t)y * m_Width; }
+    const Pixel* Row(int y) const { return m_Buffer + (size_t)y * m_Width; }
+
+    /* Clipping */
+public:
+    // Every draw call is clipped by this rect, it is always inside the buffer
+    void SetClip(int x1, int y1, int x2, int y2)
+    {
+        m_Clip.Left = std::max(x1, 0);
+        m_Clip.Top = std::max(y1, 0);
+        m_Clip.Right = std::min(x2, m_Width);
+        m_Clip.Bottom = std::min(y2, m_Height);
+    }
+    void ResetClip() { m_Clip = { 0, 0, m_Width, m_Height }; }
+    const ClipRect& Clip() const { return m_Clip; }
+
+    /* Write counting */
+public:
+#ifdef CE_OVERDRAW
+    ///<summary> Count one write of Length cells from First, every write path calls it </summary>
+    ///<remarks> Counters saturate at 0xFFFF </remarks>
+    void CountWrites(const Pixel* First, int Length)
+    {
+        uint16_t* counts = m_Counts + (First - m_Buffer);
+        for (int i = 0; i < Length; ++i)
+            counts[i] += counts[i] != 0xFFFF;
+        m_Total->fetch_add((uint64_t)Length, std::memory_order_relaxed);
+    }
+    // Writes of every cell since the last ResetWriteCounts(), Width x Height values
+    const uint16_t* WriteCounts() const { return m_Counts; }
+    uint64_t WriteTotal() const { return m_Total->load(std::memory_order_relaxed); }
+    void ResetWriteCounts()
+    {
+        std::fill(m_Counts, m_Counts + (size_t)m_Width * m_Height, (uint16_t)0);
+        m_Total->store(0, std::memory_order_relaxed);
+    }
+#else
+    void CountWrites(const Pixel*, int) {}
+#endif
+
+    /* Buffer operations */
+public:
+    // Fill the whole buffer ignoring clip, not counted as writes since it starts a new picture
+    void Clear(short Character = L' ', short Color = 0)
+    {
+        Pixel pixel;
+        pixel.Char.UnicodeChar = Character;
+        pixel.Attributes = Color;
+        std::fill(m_Buffer, m_Buffer + (size_t)m_Width * m_Height, pixel);
+    }
+
+    Pixel Get(int x, int y) const
+    {
+        if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
+            return m_Buffer[(size_t)y * m_Width + x];
+        return {};
+    }
+
+    ///<summary> Copy this buffer to Destination at (x,y), clipped by its clip rect </summary>
+    void Blit(RenderTarget& Destination, int x, int y) const
+    {
+        Blit(Destination, x, y, 0, 0, m_Width, m_Height);
+    }
+    ///<summary> Copy Width x Height region starting at (SourceX,SourceY) to Destination at (x,y) </summary>
+    void Blit(RenderTarget& Destination, int x, int y, int SourceX, int SourceY, int Width, int Height) const
+    {
+        Copy(Destination, x, y, SourceX, SourceY, Width, Height, [](Pixel* To, const Pixel* From, int Length)
+        {
+            memmove(To, From, sizeof(Pixel) * Length);
+        });
+    }
+
+    ///<summary> Like Blit, but cells with KeyCharacter are transparent and keep destination </summary>
+    void Composite(RenderTarget& Destination, int x, int y, short KeyCharacter = L' ') const
+    {
+        Composite(Destination, x, y, 0, 0, m_Width, m_Height, KeyCharacter);
+    }
+    void Composite(RenderTarget& Destination, int x, int y, int SourceX, int SourceY, int Width, int Height, short KeyCharacter = L' ') const
+    {
+        Copy(Destination, x, y, SourceX, SourceY, Width, Height, [KeyCharacter](Pixel* To, const Pixel* From, int Length)
+        {
+            CompositeSpan(To, From, Length, KeyCharacter);
+        });
+    }
+
+    // Copy Length cells except ones with KeyCharacter
+    static void CompositeSpan(Pixel* To, const Pixel* From, int Length, short KeyCharacter)
+    {
+        int i = 0;
+#ifdef CE_SIMD_SSE2
+        // Pixel is 4 bytes with character in the low half, so four cells compare at once
+        const __m128i char_mask = _mm_set1_epi32(0xFFFF);
+        const __m128i key = _mm_set1_epi32((unsigned short)KeyCharacter);
+        for (; i + 4 <= Length; i += 4)
+        {
+            __m128i source = _mm_loadu_si128((const __m128i*)(From + i));
+            __m128i target = _mm_loadu_si128((const __m128i*)(To + i));
+            __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(source, char_mask), key);
+            __m128i result = _mm_or_si128(_mm_and_si128(transparent, target), _mm_andnot_si128(transparent, source));
+            _mm_storeu_si128((__m128i*)(To + i), result);
+        }
+#endif
+        for (; i < Length; ++i)
+            if (From[i].Char.UnicodeChar != KeyCharacter)
+                To[i] = From[i];
+    }
+
+private:
+    // Clip source region by source bounds and destination clip, then run CopyRow for every row
+    template < typename CopyFunc >
+    void Copy(RenderTarget& Destination, int x, int y, int SourceX, int SourceY, int Width, int Height, CopyFunc CopyRow) const
+    {
+        if (SourceX < 0) { x -= SourceX; Width += SourceX; SourceX = 0; }
+        if (SourceY < 0) { y -= SourceY; Height += SourceY; SourceY = 0; }
+        Width = std::min(Width, m_Width - SourceX);
+        Height = std::min(Height, m_Height - SourceY);
+
+        const ClipRect& clip = Destination.Clip();
+        if (x < clip.Left) { SourceX += clip.Left - x; Width -= clip.Left - x; x = clip.Left; }
+        if (y < clip.Top) { SourceY += clip.Top - y; Height -= clip.Top - y; y = clip.Top; }
+        Width = std::min(Width, clip.Right - x);
+        Height = std::min(Height, clip.Bottom - y);
+        if (Width <= 0 || Height <= 0)
+            return;
+
+        for (int row = 0; row < Height; ++row)
+        {
+            Pixel* to = Destination.Row(y + row) + x;
+            CopyRow(to, Row(SourceY + row) + SourceX, Width);
+            Destination.CountWrites(to, Width);
+        }
+    }
+
+    std::vector<Pixel> m_Storage;       // Empty for attached buffers
+    Pixel* m_Buffer = nullptr;
+    int m_Width = 0, m_Height = 0;
+    ClipRect m_Clip;
+#ifdef CE_OVERDRAW
+    void OwnWriteCounts()
+    {
+        m_WriteCounts.assign((size_t)m_Width * m_Height, 0);
+        m_WriteTotal = 0;
+        m_Counts = m_WriteCounts.data();
+        m_Total = &m_WriteTotal;
+    }
+
+    std::vector<uint16_t> m_WriteCounts;
+    std::atomic<uint64_t> m_WriteTotal{ 0 };    // Views of several threads add to it at once
+    uint16_t* m_Counts = nullptr;               // Own counters or counters of the parent of a view
+    std::atomic<uint64_t>* m_Total = &m_WriteTotal;
+#endif
+};
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <stf/ConsoleEngine.h>
+#include <stf/WorkerPool.h>
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+// Size of the screen tile that rasterized by one job, in cells
+#define CE_RASTER_TILE_WIDTH 32
+#define CE_RASTER_TILE_HEIGHT 16
+
+// Point or direction in 3D space
+struct Vertex3
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+};
+
+/* 4x4 row-major matrix, transforms column vectors: v' = M * v */
+struct Matrix3D
+{
+    float m[16] = { 0.0f };
+
+    static Matrix3D Identity()
+    {
+        Matrix3D r;
+        r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+        return r;
+    }
+    static Matrix3D Translation(float x, float y, float z)
+    {
+        Matrix3D r = Identity();
+        r.m[3] = x; r.m[7] = y; r.m[11] = z;
+        return r;
+    }
+    static Matrix3D Scale(float x, float y, float z)
+    {
+        Matrix3D r = Identity();
+        r.m[0] = x; r.m[5] = y; r.m[10] = z;
+        return r;
+    }
+    static Matrix3D RotationX(float Angle)
+    {
+        Matrix3D r = Identity();
+        float c = cosf(Angle), s = sinf(Angle);
+        r.m[5] = c; r.m[6] = -s; r.m[9] = s; r.m[10] = c;
+        return r;
+    }
+    static Matrix3D RotationY(float Angle)
+    {
+        Matrix3D r = Identity();
+        float c = cosf(Angle), s = sinf(Angle);
+        r.m[0] = c; r.m[2] = s; r.m[8] = -s; r.m[10] = c;
+        return r;
+    }
+    static Matrix3D RotationZ(float Angle)
+    {
+        Matrix3D r = Identity();
+        float c = cosf(Angle), s = sinf(Angle);
+        r.m[0] = c; r.m[1] = -s; r.m[4] = s; r.m[5] = c;
+        return r;
+    }
+
+    ///<summary> Left-handed perspective projection, camera looks along +z, depth mapped to [0, 1] </summary>
+    ///<param name="Aspect"> Width / height of the viewport in real pixels, not in cells </param>
+    static Matrix3D Perspective(float FovY, float Aspect, float Near, float Far)
+    {
+        Matrix3D r;
+        float f = 1.0f / tanf(FovY * 0.5f);
+        r.m[0] = f / Aspect;
+        r.m[5] = f;
+        r.m[10] = Far / (Far - Near);
+        r.m[11] = -Near * Far / (Far - Near);
+        r.m[14] = 1.0f;
+        return r;
+    }
+
+    // Left-handed view matrix
+    static Matrix3D LookAt(Vertex3 Eye, Vertex3 Target, Vertex3 Up)
+    {
+        Vertex3 z = Normalize({ Target.x - Eye.x, Target.y - Eye.y, Target.z - Eye.z });
+        Vertex3 x = Normalize(Cross(Up, z));
+        Vertex3 y = Cross(z, x);
+        Matrix3D r = Identity();
+        r.m[0] = x.x; r.m[1] = x.y; r.m[2] = x.z; r.m[3] = -Dot(x, Eye);
+        r.m[4] = y.x; r.m[5] = y.y; r.m[6] = y.z; r.m[7] = -Dot(y, Eye);
+        r.m[8] = z.x; r.m[9] = z.y; r.m[10] = z.z; r.m[11] = -Dot(z, Eye);
+        return r;
+    }
+
+    Matrix3D operator*(const Matrix3D& Other) const
+    {
+        Matrix3D r;
+        for (int row = 0; row < 4; ++row)
+            for (int col = 0; col < 4; ++col)
+                for (int k = 0; k < 4; ++k)
+                    r.m[row * 4 + col] += m[row * 4 + k] * Other.m[k * 4 + col];
+        return r;
+    }
+
+    static float Dot(Vertex3 a, Vertex3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    static Vertex3 Cross(Vertex3 a, Vertex3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    static Vertex3 Normalize(Vertex3 v)
+    {
+        float length = sqrtf(Dot(v, v));
+        return length > 0.0f ? Vertex3{ v.x / length, v.y / length, v.z / length } : v;
+    }
+};
+
+// Indexed triangle list, triangle colors are FG_* values used as base of shading
+struct Mesh
+{
+    std::vector<Vertex3> Vertices;
+    std::vector<uint32_t> Indices;      // Three per triangle
+    std::vector<short> Colors;          // One per triangle, FG_WHITE if empty
+};
+
+/* Flat shaded triangle renderer with depth buffer, triangles binned to tiles and tiles rasterized in parallel */
+class MeshRenderer
+{
+public:
+    MeshRenderer() = default;
+    explicit MeshRenderer(size_t Workers) : m_Pool(Workers) {}
+
+    // Directional light, Ambient is the lowest intensity of unlit faces
+    void SetLight(Vertex3 Direction, float Ambient = 0.2f)
+    {
+        m_LightDirection = Matrix3D::Normalize(Direction);
+        m_Ambient = Ambient;
+    }
+    void SetBackfaceCulling(bool Enable) { m_CullBackfaces = Enable; }
+
+    // Reset depth and bins, must be called once per frame before Submit()
+    void BeginFrame(int Width, int Height)
+    {
+        if (Width != m_Width || Height != m_Height)
+        {
+            m_Width = Width;
+            m_Height = Height;
+            m_TilesX = (Width + CE_RASTER_TILE_WIDTH - 1) / CE_RASTER_TILE_WIDTH;
+            m_TilesY = (Height + CE_RASTER_TILE_HEIGHT - 1) / CE_RASTER_TILE_HEIGHT;
+            m_Depth.resize((size_t)Width * Height);
+            m_Color.resize((size_t)Width * Height);
+            m_Bins.resize((size_t)m_TilesX * m_TilesY);
+        }
+        for (auto& bin : m_Bins)
+            bin.clear();
+        m_Triangles.clear();
+    }
+
+    ///<summary> Transform, clip, cull and bin mesh triangles </summary>
+    ///<param name="ViewProjection"> Usually Perspective(...) * LookAt(...) </param>
+    void Submit(const Mesh& Object, const Matrix3D& Model, const Matrix3D& ViewProjection)
+    {
+        // Batched transform of all vertices to world and clip space
+        const Matrix3D mvp = ViewProjection * Model;
+        const size_t count = Object.Vertices.size();
+        m_World.resize(count);
+        m_Clip.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vertex3& v = Object.Vertices[i];
+            const float* w = Model.m;
+            const float* c = mvp.m;
+            m_World[i] = { w[0] * v.x + w[1] * v.y + w[2] * v.z + w[3],
+                           w[4] * v.x + w[5] * v.y + w[6] * v.z + w[7],
+                           w[8] * v.x + w[9] * v.y + w[10] * v.z + w[11] };
+            m_Clip[i] = { c[0] * v.x + c[1] * v.y + c[2] * v.z + c[3],
+                          c[4] * v.x + c[5] * v.y + c[6] * v.z + c[7],
+                          c[8] * v.x + c[9] * v.y + c[10] * v.z + c[11],
+                          c[12] * v.x + c[13] * v.y + c[14] * v.z + c[15] };
+        }
+
+        for (size_t t = 0; t + 2 < Object.Indices.size(); t += 3)
+        {
+            const uint32_t ia = Object.Indices[t], ib = Object.Indices[t + 1], ic = Object.Indices[t + 2];
+            const ClipVertex& a = m_Clip[ia];
+            const ClipVertex& b = m_Clip[ib];
+            const ClipVertex& c = m_Clip[ic];
+
+            // Trivial reject when all vertices outside of the same plane
+            if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+                (a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+                (a.z > a.w && b.z > b.w && c.z > c.w) || (a.z < 0.0f && b.z < 0.0f && c.z < 0.0f))
+                continue;
+
+            // Flat lighting from the world space face normal
+            Vertex3 wa = m_World[ia], wb = m_World[ib], wc = m_World[ic];
+            Vertex3 normal = Matrix3D::Normalize(Matrix3D::Cross(
+                { wb.x - wa.x, wb.y - wa.y, wb.z - wa.z }, { wc.x - wa.x, wc.y - wa.y, wc.z - wa.z }));
+            float diffuse = -Matrix3D::Dot(normal, m_LightDirection);
+            float intensity = m_Ambient + (diffuse > 0.0f ? diffuse : 0.0f) * (1.0f - m_Ambient);
+            short color = Object.Colors.empty() ? (short)FG_WHITE : Object.Colors[t / 3];
+            Pixel shade = ShadeCell(color, intensity);
+
+            // Near plane clipping, a triangle becomes polygon of up to four vertices
+            ClipVertex polygon[4];
+            int vertices = ClipNear(a, b, c, polygon);
+            for (int i = 1; i + 1 < vertices; ++i)
+                SetupTriangle(polygon[0], polygon[i], polygon[i + 1], shade);
+        }
+    }
+
+    // Rasterize all bins in parallel and copy covered cells to the screen
+    void Render(ConsoleEngine& Engine)
+    {
+        m_Pool.ParallelFor(m_Bins.size(), [this](size_t Tile) { RasterizeTile(Tile); });
+
+        // Copy runs of covered cells, cells without triangles stay untouched
+        for (int y = 0; y < m_Height; ++y)
+        {
+            const float* depth = m_Depth.data() + (size_t)y * m_Width;
+            int x = 0;
+            while (x < m_Width)
+            {
+                while (x < m_Width && depth[x] == FLT_MAX)
+                    ++x;
+                int start = x;
+                while (x < m_Width && depth[x] != FLT_MAX)
+                    ++x;
+                if (x > start)
+                    Engine.DrawSpan(start, y, m_Color.data() + (size_t)y * m_Width + start, x - start);
+            }
+        }
+    }
+
+    size_t TriangleCount() const { return m_Triangles.size(); }
+
+    // Map light intensity [0, 1] of the base color to shade glyph and attributes
+    static Pixel ShadeCell(short Color, float Intensity)
+    {
+        const short dark = Color & 0x7;
+        const short bright = dark | 0x8;
+        constexpr const short glyphs[4] = { QUAD::QUARTER, QUAD::HALF, QUAD::THREEQUARTERS, QUAD::SOLID };
+
+        int level = (int)(Intensity * 8.0f + 0.5f);
+        level = level < 0 ? 0 : (level > 8 ? 8 : level);
+
+        Pixel pixel;
+        if (level == 0)
+        {
+            pixel.Char.UnicodeChar = L' ';
+            pixel.Attributes = FG_BLACK | BG_BLACK;
+        }
+        else if (level <= 4)
+        {
+            pixel.Char.UnicodeChar = glyphs[level - 1];
+            pixel.Attributes = dark;
+        }
+        else
+        {
+            pixel.Char.UnicodeChar = glyphs[level - 5];
+            pixel.Attributes = bright | (dark << 4);
+        }
+        return pixel;
+    }
+
+private:
+    struct ClipVertex
+    {
+        float x, y, z, w;
+    };
+
+    // Edge functions and depth plane of screen space triangle
+    struct RasterTriangle
+    {
+        float EdgeA[3], EdgeB[3], EdgeC[3];     // E(x, y) = A * x + B * y + C, inside when all >= 0
+        float DepthA, DepthB, DepthC;           // Depth(x, y) = A * x + B * y + C
+        int MinX, MinY, MaxX, MaxY;             // Inclusive bounding box in cells
+        Pixel Shade;
+    };
+
+    static int ClipNear(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, ClipVertex* Out)
+    {
+        const ClipVertex input[3] = { a, b, c };
+        int count = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const ClipVertex& from = input[i];
+            const ClipVertex& to = input[(i + 1) % 3];
+            bool from_inside = from.z >= 0.0f, to_inside = to.z >= 0.0f;
+            if (from_inside)
+                Out[count++] = from;
+            if (from_inside != to_inside)
+            {
+                float t = from.z / (from.z - to.z);
+                Out[count++] = { from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t, 0.0f, from.w + (to.w - from.w) * t };
+            }
+        }
+        return count;
+    }
+
+    void SetupTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, Pixel Shade)
+    {
+        // Perspective divide and viewport transform, y goes down on the screen
+        float x0 = (a.x / a.w * 0.5f + 0.5f) * m_Width, y0 = (0.5f - a.y / a.w * 0.5f) * m_Height, z0 = a.z / a.w;
+        float x1 = (b.x / b.w * 0.5f + 0.5f) * m_Width, y1 = (0.5f - b.y / b.w * 0.5f) * m_Height, z1 = b.z / b.w;
+        float x2 = (c.x / c.w * 0.5f + 0.5f) * m_Width, y2 = (0.5f - c.y / c.w * 0.5f) * m_Height, z2 = c.z / c.w;
+
+        // Counter-clockwise faces are front ones, on the screen with y down they have negative area
+        float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        if (area == 0.0f || (m_CullBackfaces && area > 0.0f))
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+            area = -area;
+        }
+
+        RasterTriangle tri;
+        tri.MinX = std::max((int)floorf(std::min({ x0, x1, x2 })), 0);
+        tri.MinY = std::max((int)floorf(std::min({ y0, y1, y2 })), 0);
+        tri.MaxX = std::min((int)ceilf(std::max({ x0, x1, x2 })), m_Width - 1);
+        tri.MaxY = std::min((int)ceilf(std::max({ y0, y1, y2 })), m_Height - 1);
+        if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+            return;
+
+        // Edge from vertex i to vertex j, positive inside for triangle with positive area
+        const float xs[3] = { x0, x1, x2 }, ys[3] = { y0, y1, y2 };
+        for (int i = 0; i < 3; ++i)
+        {
+            int j = (i + 1) % 3;
+            tri.EdgeA[i] = ys[i] - ys[j];
+            tri.EdgeB[i] = xs[j] - xs[i];
+            tri.EdgeC[i] = xs[i] * ys[j] - xs[j] * ys[i];
+            // Top-left rule: cells exactly on right or bottom edges belong to the neighbour triangle
+            bool top_left = tri.EdgeA[i] > 0.0f || (tri.EdgeA[i] == 0.0f && tri.EdgeB[i] < 0.0f);
+            if (!top_left)
+                tri.EdgeC[i] -= 1e-5f;
+        }
+
+        // Depth plane through three vertices
+        float inv_area = 1.0f / area;
+        tri.DepthA = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * inv_area;
+        tri.DepthB = ((x1 - x0) * (z2 - z0) - (x2 - x0) * (z1 - z0)) * inv_area;
+        tri.DepthC = z0 - tri.DepthA * x0 - tri.DepthB * y0;
+        tri.Shade = Shade;
+
+        // Bin to every tile the bounding box touches
+        const uint32_t index = (uint32_t)m_Triangles.size();
+        m_Triangles.push_back(tri);
+        for (int ty = tri.MinY / CE_RASTER_TILE_HEIGHT; ty <= tri.MaxY / CE_RASTER_TILE_HEIGHT; ++ty)
+            for (int tx = tri.MinX / CE_RASTER_TILE_WIDTH; tx <= tri.MaxX / CE_RASTER_TILE_WIDTH; ++tx)
+                m_Bins[ty * m_TilesX + tx].push_back(index);
+    }
+
+    // Runs on the worker thread, tiles don't overlap so no synchronization needed
+    void RasterizeTile(size_t Tile)
+    {
+        const int tile_x = (int)(Tile % m_TilesX) * CE_RASTER_TILE_WIDTH;
+        const int tile_y = (int)(Tile / m_TilesX) * CE_RASTER_TILE_HEIGHT;
+        const int tile_x2 = std::min(tile_x + CE_RASTER_TILE_WIDTH, m_Width) - 1;
+        const int tile_y2 = std::min(tile_y + CE_RASTER_TILE_HEIGHT, m_Height) - 1;
+
+        for (int y = tile_y; y <= tile_y2; ++y)
+            std::fill(m_Depth.begin() + (size_t)y * m_Width + tile_x, m_Depth.begin() + (size_t)y * m_Width + tile_x2 + 1, FLT_MAX);
+
+        for (uint32_t index : m_Bins[Tile])
+        {
+            const RasterTriangle& tri = m_Triangles[index];
+            const int x1 = std::max(tri.MinX, tile_x), x2 = std::min(tri.MaxX, tile_x2);
+            const int y1 = std::max(tri.MinY, tile_y), y2 = std::min(tri.MaxY, tile_y2);
+
+            for (int y = y1; y <= y2; ++y)
+            {
+                // Sample at cell centers, step edge functions along the row
+                const float py = y + 0.5f, px = x1 + 0.5f;
+                float e0 = tri.EdgeA[0] * px + tri.EdgeB[0] * py + tri.EdgeC[0];
+                float e1 = tri.EdgeA[1] * px + tri.EdgeB[1] * py + tri.EdgeC[1];
+                float e2 = tri.EdgeA[2] * px + tri.EdgeB[2] * py + tri.EdgeC[2];
+                float depth = tri.DepthA * px + tri.DepthB * py + tri.DepthC;
+                float* depth_row = m_Depth.data() + (size_t)y * m_Width;
+                Pixel* color_row = m_Color.data() + (size_t)y * m_Width;
+                for (int x = x1; x <= x2; ++x)
+                {
+                    if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f && depth < depth_row[x])
+                    {
+                        depth_row[x] = depth;
+                        color_row[x] = tri.Shade;
+                    }
+                    e0 += tri.EdgeA[0]; e1 += tri.EdgeA[1]; e2 += tri.EdgeA[2];
+                    depth += tri.DepthA;
+                }
+            }
+        }
+    }
+
+    WorkerPool m_Pool;
+
+    int m_Width = 0, m_Height = 0;
+    int m_TilesX = 0, m_TilesY = 0;
+    std::vector<float> m_Depth;
+    std::vector<Pixel> m_Color;
+
+    std::vector<RasterTriangle> m_Triangles;
+    std::vector<std::vector<uint32_t>> m_Bins;      // Triangle indices per tile in submission order
+
+    std::vector<Vertex3> m_World;                   // Submit() scratch
+    std::vector<ClipVertex> m_Clip;
+
+    Vertex3 m_LightDirection = Matrix3D::Normalize({ -0.5f, -1.0f, 1.0f });
+    float m_Ambient = 0.2f;
+    bool m_CullBackfaces = true;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+
+#include <math.h>
+#include <vector>
+
+#define CE_DYNRES_DOWN_FRAMES 3         // Frames over budget in a row before resolution drops
+#define CE_DYNRES_UP_FRAMES 30          // Frames with headroom in a row before resolution grows
+#define CE_DYNRES_HEADROOM 0.7          // Frame time below this part of budget is headroom
+#define CE_DYNRES_STEP_UP 1.1f          // Scale multiplier of one step up
+#define CE_DYNRES_SETTLE_FRAMES 2       // Frames ignored after a change, they still carry the old cost
+
+/* Picks render resolution from measured frame times and stretches rendered picture to the screen */
+class ResolutionScaler
+{
+public:
+    // Frame time to hold, in seconds
+    void SetBudget(double Seconds) { m_Budget = Seconds; }
+    double Budget() const { return m_Budget; }
+
+    void SetLimits(float MinScale, float MaxScale = 1.0f)
+    {
+        m_MinScale = std::max(MinScale, 0.01f);
+        m_MaxScale = std::max(MaxScale, m_MinScale);
+        m_Scale = std::min(std::max(m_Scale, m_MinScale), m_MaxScale);
+    }
+    float MinScale() const { return m_MinScale; }
+    float MaxScale() const { return m_MaxScale; }
+
+    // Part of full resolution along each axis
+    float Scale() const { return m_Scale; }
+    void Reset(float Scale = 1.0f)
+    {
+        m_Scale = std::min(std::max(Scale, m_MinScale), m_MaxScale);
+        m_Average = 0.0;
+        m_Over = m_Under = 0;
+        m_Settle = 0;
+    }
+
+    // Size along an axis of Size cells at the current scale, at least one cell
+    int Scaled(int Size) const { return std::max(1, (int)(Size * m_Scale + 0.5f)); }
+
+    ///<summary> Feed time spent on one frame, returns true when scale changed </summary>
+    ///<remarks> Drops at once in proportion to the overrun, since cost grows with area,
+    ///          and grows by small steps after long headroom, so it doesn't swing between two sizes </remarks>
+    bool AddFrame(double Seconds)
+    {
+        if (m_Settle > 0)
+        {
+            --m_Settle;
+            return false;
+        }
+        m_Average = m_Average == 0.0 ? Seconds : m_Average + (Seconds - m_Average) * 0.25;
+
+        m_Over = m_Average > m_Budget ? m_Over + 1 : 0;
+        m_Under = m_Average < m_Budget * CE_DYNRES_HEADROOM ? m_Under + 1 : 0;
+
+        float scale = m_Scale;
+        if (m_Over >= CE_DYNRES_DOWN_FRAMES)
+            scale = m_Scale * (float)sqrt(m_Budget / m_Average) * 0.95f;
+        else if (m_Under >= CE_DYNRES_UP_FRAMES)
+            scale = m_Scale * CE_DYNRES_STEP_UP;
+        scale = std::min(std::max(scale, m_MinScale), m_MaxScale);
+        if (scale == m_Scale)
+            return false;
+
+        m_Scale = scale;
+        m_Average = 0.0;
+        m_Over = m_Under = 0;
+        m_Settle = CE_DYNRES_SETTLE_FRAMES;
+        return true;
+    }
+
+    ///<summary> Stretch Source over the whole Destination by nearest cell </summary>
+    ///<remarks> Cells can't be averaged, so box filter of a magnification is the nearest cell.
+    ///          Rows that repeat are copied from the previous row. Not counted as drawing </remarks>
+    void Upscale(const RenderTarget& Source, RenderTarget& Destination)
+    {
+        const int width = Destination.Width(), height = Destination.Height();
+        if (m_Columns.size() != (size_t)width || m_SourceWidth != Source.Width())
+        {
+            m_Columns.resize(width);
+            for (int x = 0; x < width; ++x)
+                m_Columns[x] = (int)((int64_t)x * Source.Width() / width);
+            m_SourceWidth = Source.Width();
+        }
+
+        int previous = -1;
+        for (int y = 0; y < height; ++y)
+        {
+            const int source_y = (int)((int64_t)y * Source.Height() / height);
+            Pixel* to = Destination.Row(y);
+            if (source_y == previous)
+            {
+                memcpy(to, Destination.Row(y - 1), sizeof(Pixel) * width);
+                continue;
+            }
+            const Pixel* from = Source.Row(source_y);
+            for (int x = 0; x < width; ++x)
+                to[x] = from[m_Columns[x]];
+            previous = source_y;
+        }
+    }
+
+private:
+    double m_Budget = 1.0 / 60.0;
+    float m_MinScale = 0.5f, m_MaxScale = 1.0f;
+    float m_Scale = 1.0f;
+
+    double m_Average = 0.0;             // Smoothed frame time since the last change
+    int m_Over = 0, m_Under = 0;        // Frames in a row over budget and with headroom
+    int m_Settle = 0;
+
+    std::vector<int> m_Columns;         // Source column of every destination column
+    int m_SourceWidth = 0;
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stf/Canvas.h>
+
+#include <vector>
+
+#include <stdint.h>
+#include <limits.h>
+
+#define CE_BLEND_LEVELS 16      // Alpha quantization steps, alpha 0 and 255 are exact
+
+/* Alpha blending of the 16 color palette with shade glyphs as dithering */
+class ShadeCompositor
+{
+public:
+    ShadeCompositor() { SetPalette(DefaultPalette()); }
+
+    // 0x00RRGGBB of console colors in COLOR order, tables are rebuilt
+    void SetPalette(const uint32_t* Palette)
+    {
+        for (int i = 0; i < 16; ++i)
+            m_Palette[i] = Palette[i];
+        BuildTables();
+    }
+
+    ///<summary> Color that the cell looks like, shade glyphs mix foreground and background </summary>
+    int ApparentColor(const Pixel& Cell) const
+    {
+        return m_Apparent[Coverage(Cell.Char.UnicodeChar)][Cell.Attributes & 0xFF];
+    }
+
+    ///<summary> Blend palette Color over the cell, Alpha in [0, 255] </summary>
+    void BlendCell(Pixel& Cell, short Color, uint8_t Alpha) const
+    {
+        int level = Level(Alpha);
+        if (level != 0)
+            Cell = m_Blend[level][Color & 0x0F][ApparentColor(Cell)];
+    }
+
+    ///<summary> Blend Color over cells [x1, x2) x [y1, y2) clipped by target clip rect </summary>
+    void BlendRect(RenderTarget& Target, int x1, int y1, int x2, int y2, short Color, uint8_t Alpha) const
+    {
+        const ClipRect& clip = Target.Clip();
+        x1 = std::max(x1, clip.Left);
+        y1 = std::max(y1, clip.Top);
+        x2 = std::min(x2, clip.Right);
+        y2 = std::min(y2, clip.Bottom);
+        int level = Level(Alpha);
+        if (x1 >= x2 || y1 >= y2 || level == 0)
+            return;
+
+        // One row of the table serves the whole rect
+        const Pixel* blend = m_Blend[level][Color & 0x0F];
+        for (int y = y1; y < y2; ++y)
+        {
+            Pixel* row = Target.Row(y);
+            int x = x1;
+#ifdef CE_SIMD_SSE2
+            int index[4];
+            Pixel result[4];
+            for (; x + 4 <= x2; x += 4)
+            {
+                ApparentIndices(row + x, index);
+                for (int i = 0; i < 4; ++i)
+                    result[i] = blend[m_Apparent[index[i] >> 8][index[i] & 0xFF]];
+                memcpy(row + x, result, sizeof(result));
+            }
+#endif
+            for (; x < x2; ++x)
+                row[x] = blend[ApparentColor(row[x])];
+            Target.CountWrites(row + x1, x2 - x1);
+        }
+    }
+
+    ///<summary> Blend sprite over target, every cell contributes its apparent color </summary>
+    ///<param name="Alphas"> Per cell alpha multiplied by Alpha, nullptr for uniform alpha </param>
+    ///<param name="KeyCharacter"> Cells with this character are skipped </param>
+    void BlendSprite(RenderTarget& Target, int x, int y, const Pixel* Cells, int Width, int Height,
+        uint8_t Alpha = 255, const uint8_t* Alphas = nullptr, short KeyCharacter = L' ') const
+    {
+        const ClipRect& clip = Target.Clip();
+        const int begin_x = std::max(x, clip.Left), end_x = std::min(x + Width, clip.Right);
+        const int begin_y = std::max(y, clip.Top), end_y = std::min(y + Height, clip.Bottom);
+
+        for (int ty = begin_y; ty < end_y; ++ty)
+        {
+            Pixel* row = Target.Row(ty);
+            const size_t source_row = (size_t)(ty - y) * Width;
+            int tx = begin_x;
+#ifdef CE_SIMD_SSE2
+            int source_index[4], target_index[4];
+            for (; tx + 4 <= end_x; tx += 4)
+            {
+                ApparentIndices(Cells + source_row + (tx - x), source_index);
+                ApparentIndices(row + tx, target_index);
+                for (int i = 0; i < 4; ++i)
+                    BlendSpriteCell(Target, row[tx + i], Cells, source_row + (tx + i - x), Alpha, Alphas, KeyCharacter,
+                        m_Apparent[source_index[i] >> 8][source_index[i] & 0xFF], m_Apparent[target_index[i] >> 8][target_index[i] & 0xFF]);
+            }
+#endif
+            for (; tx < end_x; ++tx)
+            {
+                const size_t index = source_row + (tx - x);
+                BlendSpriteCell(Target, row[tx], Cells, index, Alpha, Alphas, KeyCharacter, ApparentColor(Cells[index]), ApparentColor(row[tx]));
+            }
+        }
+    }
+
+    static const uint32_t* DefaultPalette()
+    {
+        // Legacy conhost colors
+        static const uint32_t Palette[16] =
+        {
+            0x000000, 0x000080, 0x008000, 0x008080, 0x800000, 0x800080, 0x808000, 0xC0C0C0,
+            0x808080, 0x0000FF, 0x00FF00, 0x00FFFF, 0xFF0000, 0xFF00FF, 0xFFFF00, 0xFFFFFF
+        };
+        return Palette;
+    }
+
+private:
+    static constexpr int Coverages = 5;     // Empty, quarter, half, three quarters and solid
+
+    static int Level(uint8_t Alpha) { return (Alpha * (CE_BLEND_LEVELS - 1) + 127) / 255; }
+
+    void BlendSpriteCell(RenderTarget& Target, Pixel& Cell, const Pixel* Cells, size_t Index, uint8_t Alpha, const uint8_t* Alphas,
+        short KeyCharacter, int SourceColor, int TargetColor) const
+    {
+        if (Cells[Index].Char.UnicodeChar == KeyCharacter)
+            return;
+        int alpha = Alphas ? Alphas[Index] * Alpha / 255 : Alpha;
+        int level = Level((uint8_t)alpha);
+        if (level != 0)
+        {
+            Cell = m_Blend[level][SourceColor][TargetColor];
+            Target.CountWrites(&Cell, 1);
+        }
+    }
+
+#ifdef CE_SIMD_SSE2
+    ///<summary> Indices into m_Apparent of four cells, coverage * 256 + attributes </summary>
+    ///<remarks> SSE2 has no gather, so coverage and indices are found by compares four at a time
+    ///          and only the table loads stay scalar </remarks>
+    static void ApparentIndices(const Pixel* Cells, int* Out)
+    {
+        // Pixel is character in low and attributes in high half of 32 bits
+        const __m128i cells = _mm_loadu_si128((const __m128i*)Cells);
+        const __m128i chars = _mm_and_si128(cells, _mm_set1_epi32(0xFFFF));
+        __m128i coverage = _mm_and_si128(_mm_cmpeq_epi32(chars, _mm_set1_epi32((uint16_t)QUAD::QUARTER)), _mm_set1_epi32(1 << 8));
+        coverage = _mm_or_si128(coverage, _mm_and_si128(_mm_cmpeq_epi32(chars, _mm_set1_epi32((uint16_t)QUAD::HALF)), _mm_set1_epi32(2 << 8)));
+        coverage = _mm_or_si128(coverage, _mm_and_si128(_mm_cmpeq_epi32(chars, _mm_set1_epi32((uint16_t)QUAD::THREEQUARTERS)), _mm_set1_epi32(3 << 8)));
+        coverage = _mm_or_si128(coverage, _mm_and_si128(_mm_cmpeq_epi32(chars, _mm_set1_epi32((uint16_t)QUAD::SOLID)), _mm_set1_epi32(4 << 8)));
+        const __m128i attributes = _mm_and_si128(_mm_srli_epi32(cells, 16), _mm_set1_epi32(0xFF));
+        _mm_storeu_si128((__m128i*)Out, _mm_or_si128(coverage, attributes));
+    }
+#endif
+
+    // Quarters of the cell covered by foreground, other characters show mostly background
+    static int Coverage(wchar_t Character)
+    {
+        switch ((short)Character)
+        {
+        case QUAD::QUARTER: return 1;
+        case QUAD::HALF: return 2;
+        case QUAD::THREEQUARTERS: return 3;
+        case QUAD::SOLID: return 4;
+        default: return 0;
+        }
+    }
+
+    static uint32_t Mix(uint32_t A, uint32_t B, int Weight, int Total)
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int a = (A >> shift) & 0xFF, b = (B >> shift) & 0xFF;
+            result |= (uint32_t)((a * Weight + b * (Total - Weight) + Total / 2) / Total) << shift;
+        }
+        return result;
+    }
+
+    static int Distance(uint32_t A, uint32_t B)
+    {
+        int sum = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int d = (int)((A >> shift) & 0xFF) - (int)((B >> shift) & 0xFF);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    void BuildTables()
+    {
+        static const short Glyphs[Coverages] = { L' ', QUAD::QUARTER, QUAD::HALF, QUAD::THREEQUARTERS, QUAD::SOLID };
+
+        // Every cell the console can show: shade glyph, foreground and background
+        struct Candidate { uint32_t Color; Pixel Cell; };
+        std::vector<Candidate> candidates;
+        for (int coverage = 0; coverage < Coverages; ++coverage)
+            for (int attributes = 0; attributes < 256; ++attributes)
+            {
+                int fg = attributes & 0x0F, bg = attributes >> 4;
+                // Empty and solid cells ignore one of colors, keep only one variant of them
+                if ((coverage == 0 && fg != 0) || (coverage == Coverages - 1 && bg != 0))
+                    continue;
+                uint32_t color = Mix(m_Palette[fg], m_Palette[bg], coverage, Coverages - 1);
+                m_Apparent[coverage][attributes] = (uint8_t)Nearest(color);
+
+                Pixel cell;
+                cell.Char.UnicodeChar = Glyphs[coverage];
+                cell.Attributes = (short)attributes;
+                candidates.push_back({ color, cell });
+            }
+
+        // Skipped variants look the same as the kept ones
+        for (int attributes = 0; attributes < 256; ++attributes)
+        {
+            m_Apparent[0][attributes] = m_Apparent[0][attributes & 0xF0];
+            m_Apparent[Coverages - 1][attributes] = m_Apparent[Coverages - 1][attributes & 0x0F];
+        }
+
+        for (int level = 0; level < CE_BLEND_LEVELS; ++level)
+            for (int source = 0; source < 16; ++source)
+                for (int target = 0; target < 16; ++target)
+                {
+                    uint32_t color = Mix(m_Palette[source], m_Palette[target], level, CE_BLEND_LEVELS - 1);
+                    int best = INT_MAX;
+                    for (const Candidate& candidate : candidates)
+                    {
+                        int distance = Distance(color, candidate.Color);
+                        if (distance < best)
+                        {
+                            best = distance;
+                            m_Blend[level][source][target] = candidate.Cell;
+                        }
+                    }
+                }
+    }
+
+    int Nearest(uint32_t Color) const
+    {
+        int best = 0;
+        for (int i = 1; i < 16; ++i)
+            if (Distance(Color, m_Palette[i]) < Distance(Color, m_Palette[best]))
+                best = i;
+        return best;
+    }
+
+    uint32_t m_Palette[16];
+    uint8_t m_Apparent[Coverages][256];                 // Cell look -> nearest palette color
+    Pixel m_Blend[CE_BLEND_LEVELS][16][16];             // Alpha level, source and target colors -> cell
+};
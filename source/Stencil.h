@@ -0,0 +1,405 @@
+#pragma once
+
+#include <stf/RenderTarget.h>
+#include <stf/WorkerPool.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define CE_STENCIL_BAND_ROWS 8      // Rows of one parallel job, bands are taken by workers as they finish
+
+// What neighbours of border cells read outside of the grid
+enum class GRID_EDGE : short
+{
+    CONSTANT = 0x0,     // Edge value, zero state by default
+    CLAMP,              // Nearest border cell
+    WRAP                // Opposite side, grid is a torus
+};
+
+/* Row bands of a grid executed on a worker pool */
+class GridWorkers
+{
+public:
+    // Share pool with other users, nullptr makes grid create its own on the first step
+    void SetWorkerPool(WorkerPool* Pool) { m_Pool = Pool; }
+
+protected:
+    // Call Band(y1, y2) for rows [0, Rows) split in bands of CE_STENCIL_BAND_ROWS
+    template < typename BandFunc >
+    void ForEachBand(int Rows, BandFunc&& Band)
+    {
+        const int bands = (Rows + CE_STENCIL_BAND_ROWS - 1) / CE_STENCIL_BAND_ROWS;
+        if (bands <= 1)
+        {
+            Band(0, Rows);
+            return;
+        }
+        if (!m_Pool)
+        {
+            if (!m_OwnPool)
+                m_OwnPool.reset(new WorkerPool);
+            m_Pool = m_OwnPool.get();
+        }
+        m_Pool->ParallelFor(bands, [&](size_t Index)
+        {
+            const int y1 = (int)Index * CE_STENCIL_BAND_ROWS;
+            Band(y1, std::min(y1 + CE_STENCIL_BAND_ROWS, Rows));
+        });
+    }
+
+    // Clip Width x Height grid drawn at (x,y) by the target clip rect, false when nothing is visible
+    static bool ClipDraw(const RenderTarget& Target, int x, int y, int Width, int Height, int& x1, int& y1, int& x2, int& y2)
+    {
+        const ClipRect& clip = Target.Clip();
+        x1 = std::max(x, clip.Left);
+        y1 = std::max(y, clip.Top);
+        x2 = std::min(x + Width, clip.Right);
+        y2 = std::min(y + Height, clip.Bottom);
+        return x1 < x2 && y1 < y2;
+    }
+
+private:
+    WorkerPool* m_Pool = nullptr;
+    std::unique_ptr<WorkerPool> m_OwnPool;
+};
+
+// Cell and its neighbours of the current generation, given to stencil kernels
+template < typename T >
+struct Neighbors
+{
+    const T* Cell;
+    ptrdiff_t Stride;
+    int x, y;
+
+    const T& Self() const { return *Cell; }
+    // Neighbour at offset (dx,dy), both in [-1, 1]
+    const T& operator()(int dx, int dy) const { return Cell[dy * Stride + dx]; }
+};
+
+/* Double buffered grid of per cell state, every step computes the next generation from the current one.
+   Buffers have one cell of halo around, so kernels read neighbours of border cells without checks.
+   Boolean automata should use LifeGrid, or uint8_t here, since std::vector<bool> has no Row() pointers */
+template < typename T >
+class StencilGrid : public GridWorkers
+{
+public:
+    StencilGrid() = default;
+    StencilGrid(int Width, int Height, GRID_EDGE Edge = GRID_EDGE::CONSTANT) : m_Edge(Edge) { Resize(Width, Height); }
+
+    // Both generations are filled with T{}
+    void Resize(int Width, int Height)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Stride = Width + 2;
+        m_Current.assign((size_t)m_Stride * (Height + 2), T{});
+        m_Next.assign(m_Current.size(), T{});
+    }
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+
+    void SetEdge(GRID_EDGE Edge, const T& Value = T{})
+    {
+        m_Edge = Edge;
+        m_EdgeValue = Value;
+    }
+
+    /* Cells of the current generation */
+public:
+    const T& Get(int x, int y) const { return Row(y)[x]; }
+    void Set(int x, int y, const T& Value) { Row(y)[x] = Value; }
+    void Fill(const T& Value)
+    {
+        for (int y = 0; y < m_Height; ++y)
+            std::fill_n(Row(y), m_Width, Value);
+    }
+    T* Row(int y) { return m_Current.data() + (size_t)(y + 1) * m_Stride + 1; }
+    const T* Row(int y) const { return m_Current.data() + (size_t)(y + 1) * m_Stride + 1; }
+
+    ///<summary> Next generation of every cell is Kernel(const Neighbors<T>&), computed in row bands on workers </summary>
+    ///<remarks> Kernel reads only the current generation, so it must not keep state shared between cells </remarks>
+    template < typename KernelFunc >
+    void Step(KernelFunc&& Kernel)
+    {
+        if (m_Width == 0 || m_Height == 0)
+            return;
+        FillHalo();
+        ForEachBand(m_Height, [&](int y1, int y2)
+        {
+            for (int y = y1; y < y2; ++y)
+            {
+                const size_t row = (size_t)(y + 1) * m_Stride + 1;
+                Neighbors<T> cell{ m_Current.data() + row, m_Stride, 0, y };
+                T* out = m_Next.data() + row;
+                for (int x = 0; x < m_Width; ++x, ++cell.Cell)
+                {
+                    cell.x = x;
+                    out[x] = Kernel(cell);
+                }
+            }
+        });
+        m_Current.swap(m_Next);
+    }
+
+    ///<summary> Write Map(const T&) -> Pixel of every cell to Target at (x,y), clipped by its clip rect </summary>
+    template < typename MapFunc >
+    void Draw(RenderTarget& Target, int x, int y, MapFunc&& Map) const
+    {
+        int x1, y1, x2, y2;
+        if (!ClipDraw(Target, x, y, m_Width, m_Height, x1, y1, x2, y2))
+            return;
+        for (int ty = y1; ty < y2; ++ty)
+        {
+            const T* cells = Row(ty - y) + (x1 - x);
+            Pixel* out = Target.Row(ty) + x1;
+            for (int tx = 0; tx < x2 - x1; ++tx)
+                out[tx] = Map(cells[tx]);
+            Target.CountWrites(out, x2 - x1);
+        }
+    }
+
+private:
+    // Halo of the current generation from edge mode, rows first, then columns including corners
+    void FillHalo()
+    {
+        T* top = m_Current.data();
+        T* bottom = m_Current.data() + (size_t)(m_Height + 1) * m_Stride;
+        for (int y = 0; y < m_Height; ++y)
+        {
+            T* row = Row(y);
+            switch (m_Edge)
+            {
+            case GRID_EDGE::CONSTANT: row[-1] = row[m_Width] = m_EdgeValue; break;
+            case GRID_EDGE::CLAMP: row[-1] = row[0]; row[m_Width] = row[m_Width - 1]; break;
+            case GRID_EDGE::WRAP: row[-1] = row[m_Width - 1]; row[m_Width] = row[0]; break;
+            }
+        }
+        switch (m_Edge)
+        {
+        case GRID_EDGE::CONSTANT:
+            std::fill_n(top, m_Stride, m_EdgeValue);
+            std::fill_n(bottom, m_Stride, m_EdgeValue);
+            break;
+        case GRID_EDGE::CLAMP:
+            std::copy_n(Row(0) - 1, m_Stride, top);
+            std::copy_n(Row(m_Height - 1) - 1, m_Stride, bottom);
+            break;
+        case GRID_EDGE::WRAP:
+            std::copy_n(Row(m_Height - 1) - 1, m_Stride, top);
+            std::copy_n(Row(0) - 1, m_Stride, bottom);
+            break;
+        }
+    }
+
+    std::vector<T> m_Current, m_Next;
+    int m_Width = 0, m_Height = 0;
+    ptrdiff_t m_Stride = 0;
+    GRID_EDGE m_Edge = GRID_EDGE::CONSTANT;
+    T m_EdgeValue{};
+};
+
+/* Boolean automaton with one bit per cell. Neighbour counts of 64 cells are summed at once
+   by bit sliced adders over words, so a step costs a few dozens of operations per 64 cells */
+class LifeGrid : public GridWorkers
+{
+public:
+    LifeGrid() = default;
+    LifeGrid(int Width, int Height, GRID_EDGE Edge = GRID_EDGE::CONSTANT) : m_Edge(Edge) { Resize(Width, Height); }
+
+    // All cells are cleared, CLAMP edge works as CONSTANT of dead cells
+    void Resize(int Width, int Height)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Words = (Width + 63) / 64;
+        m_Stride = m_Words + 2;
+        m_Current.assign((size_t)m_Stride * (Height + 2), 0);
+        m_Next.assign(m_Current.size(), 0);
+    }
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+    void SetEdge(GRID_EDGE Edge) { m_Edge = Edge; }
+
+    ///<summary> Bit n of Birth makes dead cell with n neighbours alive, bit n of Survive keeps alive cell </summary>
+    void SetRule(uint16_t Birth, uint16_t Survive)
+    {
+        m_Birth = Birth;
+        m_Survive = Survive;
+    }
+    // Rule in "B3/S23" notation, returns false and keeps the rule when text is not valid
+    bool SetRule(const char* Rule)
+    {
+        uint16_t birth = 0, survive = 0;
+        uint16_t* target = nullptr;
+        for (; *Rule; ++Rule)
+        {
+            if (*Rule == 'B' || *Rule == 'b') target = &birth;
+            else if (*Rule == 'S' || *Rule == 's') target = &survive;
+            else if (*Rule >= '0' && *Rule <= '8' && target) *target |= 1 << (*Rule - '0');
+            else if (*Rule != '/') return false;
+        }
+        SetRule(birth, survive);
+        return true;
+    }
+
+    /* Cells of the current generation */
+public:
+    bool Get(int x, int y) const { return (Row(y)[x >> 6] >> (x & 63)) & 1; }
+    void Set(int x, int y, bool Alive)
+    {
+        uint64_t& word = Row(y)[x >> 6];
+        const uint64_t bit = 1ull << (x & 63);
+        word = Alive ? word | bit : word & ~bit;
+    }
+    void Clear() { std::fill(m_Current.begin(), m_Current.end(), 0); }
+    size_t Population() const
+    {
+        // Last word can hold the halo bit of column Width
+        size_t count = 0;
+        for (int y = 0; y < m_Height; ++y)
+            for (int w = 0; w < m_Words; ++w)
+                count += PopCount(Row(y)[w] & (w == m_Words - 1 ? TailMask() : ~0ull));
+        return count;
+    }
+
+    // Compute the next generation in row bands on workers
+    void Step()
+    {
+        if (m_Width == 0 || m_Height == 0)
+            return;
+        FillHalo();
+        const uint64_t tail = TailMask();
+        ForEachBand(m_Height, [&](int y1, int y2)
+        {
+            for (int y = y1; y < y2; ++y)
+            {
+                const uint64_t* up = Row(y - 1);
+                const uint64_t* mid = Row(y);
+                const uint64_t* down = Row(y + 1);
+                uint64_t* out = m_Next.data() + (size_t)(y + 1) * m_Stride + 1;
+                for (int w = 0; w < m_Words; ++w)
+                    out[w] = NextWord(up + w, mid + w, down + w);
+                out[m_Words - 1] &= tail;
+            }
+        });
+        m_Current.swap(m_Next);
+    }
+
+    ///<summary> Write alive and dead cells to Target at (x,y), clipped by its clip rect </summary>
+    void Draw(RenderTarget& Target, int x, int y, short AliveCharacter = 0x2588, short AliveColor = 0x000F, short DeadCharacter = L' ', short DeadColor = 0x0000) const
+    {
+        int x1, y1, x2, y2;
+        if (!ClipDraw(Target, x, y, m_Width, m_Height, x1, y1, x2, y2))
+            return;
+        Pixel cells[2];
+        cells[0].Char.UnicodeChar = DeadCharacter;
+        cells[0].Attributes = DeadColor;
+        cells[1].Char.UnicodeChar = AliveCharacter;
+        cells[1].Attributes = AliveColor;
+        for (int ty = y1; ty < y2; ++ty)
+        {
+            const uint64_t* words = Row(ty - y);
+            Pixel* out = Target.Row(ty);
+            for (int tx = x1; tx < x2; ++tx)
+            {
+                const int cx = tx - x;
+                out[tx] = cells[(words[cx >> 6] >> (cx & 63)) & 1];
+            }
+            Target.CountWrites(out + x1, x2 - x1);
+        }
+    }
+
+private:
+    // Rows -1 and Height are halo, so are words -1 and m_Words
+    uint64_t* Row(int y) { return m_Current.data() + (size_t)(y + 1) * m_Stride + 1; }
+    const uint64_t* Row(int y) const { return m_Current.data() + (size_t)(y + 1) * m_Stride + 1; }
+
+    // Bits of real cells in the last word of a row
+    uint64_t TailMask() const { return (m_Width & 63) ? (1ull << (m_Width & 63)) - 1 : ~0ull; }
+
+    // Neighbours west of bit i come from bit i - 1, the lowest bit takes the highest of the previous word
+    static uint64_t West(const uint64_t* Word) { return (Word[0] << 1) | (Word[-1] >> 63); }
+    static uint64_t East(const uint64_t* Word) { return (Word[0] >> 1) | (Word[1] << 63); }
+
+    uint64_t NextWord(const uint64_t* Up, const uint64_t* Mid, const uint64_t* Down) const
+    {
+        // Two full adders and a half adder sum eight neighbours into bit planes of 1, 2, 4 and 8
+        const uint64_t a = West(Up), b = Up[0], c = East(Up);
+        const uint64_t d = West(Mid), e = East(Mid);
+        const uint64_t f = West(Down), g = Down[0], h = East(Down);
+
+        const uint64_t s0 = a ^ b ^ c, c0 = (a & b) | (c & (a ^ b));
+        const uint64_t s1 = d ^ e ^ f, c1 = (d & e) | (f & (d ^ e));
+        const uint64_t s2 = g ^ h, c2 = g & h;
+
+        const uint64_t ones = s0 ^ s1 ^ s2;
+        const uint64_t carry = (s0 & s1) | (s2 & (s0 ^ s1));
+        const uint64_t t = c0 ^ c1 ^ c2, four_a = (c0 & c1) | (c2 & (c0 ^ c1));
+        const uint64_t twos = t ^ carry, four_b = t & carry;
+        const uint64_t fours = four_a ^ four_b, eights = four_a & four_b;
+
+        const uint64_t self = Mid[0];
+        uint64_t result = 0;
+        for (int n = 0; n <= 8; ++n)
+        {
+            const bool birth = (m_Birth >> n) & 1, survive = (m_Survive >> n) & 1;
+            if (!birth && !survive)
+                continue;
+            const uint64_t count = ((n & 1) ? ones : ~ones) & ((n & 2) ? twos : ~twos) &
+                ((n & 4) ? fours : ~fours) & ((n & 8) ? eights : ~eights);
+            result |= count & ((birth ? ~self : 0) | (survive ? self : 0));
+        }
+        return result;
+    }
+
+    // Bits of column -1 and column Width, then halo rows copied whole so corners follow
+    void FillHalo()
+    {
+        const bool wrap = m_Edge == GRID_EDGE::WRAP;
+        const int last = m_Width - 1;
+        for (int y = 0; y < m_Height; ++y)
+        {
+            uint64_t* row = Row(y);
+            const uint64_t first_cell = row[0] & 1;
+            const uint64_t last_cell = (row[last >> 6] >> (last & 63)) & 1;
+            row[-1] = wrap ? last_cell << 63 : 0;
+            row[m_Words] = 0;
+            // Column Width is bit after the last cell, inside of the last word or first bit of halo word
+            uint64_t& after = row[m_Width >> 6];
+            after = (after & ~(1ull << (m_Width & 63))) | ((wrap ? first_cell : 0) << (m_Width & 63));
+        }
+        uint64_t* top = Row(-1) - 1;
+        uint64_t* bottom = Row(m_Height) - 1;
+        if (wrap)
+        {
+            std::copy_n(Row(m_Height - 1) - 1, m_Stride, top);
+            std::copy_n(Row(0) - 1, m_Stride, bottom);
+        }
+        else
+        {
+            std::fill_n(top, m_Stride, 0);
+            std::fill_n(bottom, m_Stride, 0);
+        }
+    }
+
+    static int PopCount(uint64_t Bits)
+    {
+#ifdef _MSC_VER
+        return (int)__popcnt64(Bits);
+#else
+        return __builtin_popcountll(Bits);
+#endif
+    }
+
+    std::vector<uint64_t> m_Current, m_Next;
+    int m_Width = 0, m_Height = 0;
+    int m_Words = 0, m_Stride = 0;
+    GRID_EDGE m_Edge = GRID_EDGE::CONSTANT;
+    uint16_t m_Birth = 1 << 3, m_Survive = (1 << 2) | (1 << 3);
+};
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <stf/ShadeBlend.h>
+
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+
+// How many pixels of color framebuffer one console cell shows
+enum class SUBCELL_MODE : short
+{
+    HALF_BLOCK = 0x0,   // 1x2, upper half block with top color as foreground and bottom as background
+    QUADRANT            // 2x2, quadrant glyph with the best two colors of four
+};
+
+///<summary> Framebuffer of palette colors with several pixels per console cell </summary>
+///<remarks> Draw pixels here, then Resolve() converts every group of pixels to one cell. Quadrant
+///          mode needs a font with U+2596..U+259F glyphs, half blocks are in every console font </remarks>
+class SubCellBuffer
+{
+public:
+    SubCellBuffer() { SetPalette(ShadeCompositor::DefaultPalette()); }
+    SubCellBuffer(int Columns, int Rows, SUBCELL_MODE Mode) : SubCellBuffer() { Resize(Columns, Rows, Mode); }
+
+    // Buffer shown by Columns x Rows cells, pixels are cleared to black
+    void Resize(int Columns, int Rows, SUBCELL_MODE Mode)
+    {
+        m_Mode = Mode;
+        m_Columns = Columns;
+        m_Rows = Rows;
+        m_Width = Mode == SUBCELL_MODE::QUADRANT ? Columns * 2 : Columns;
+        m_Height = Rows * 2;
+        m_Pixels.assign((size_t)m_Width * m_Height, 0);
+    }
+
+    SUBCELL_MODE Mode() const { return m_Mode; }
+    // Size in pixels
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+    // Size in cells
+    int Columns() const { return m_Columns; }
+    int Rows() const { return m_Rows; }
+
+    // Colors are indices of the palette in low 4 bits, e.g. FG_RED
+    uint8_t* Row(int y) { return m_Pixels.data() + (size_t)y * m_Width; }
+    const uint8_t* Row(int y) const { return m_Pixels.data() + (size_t)y * m_Width; }
+
+    // 0x00RRGGBB of console colors in COLOR order, quadrant table is rebuilt
+    void SetPalette(const uint32_t* Palette)
+    {
+        for (int i = 0; i < 16; ++i)
+            m_Palette[i] = Palette[i];
+        m_Quadrants.clear();
+    }
+
+    /* Drawing, every routine is clipped by the buffer */
+public:
+    void Clear(short Color = FG_BLACK) { std::fill(m_Pixels.begin(), m_Pixels.end(), (uint8_t)(Color & 0x0F)); }
+
+    void DrawPixel(int x, int y, short Color = FG_WHITE)
+    {
+        if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
+            Row(y)[x] = Color & 0x0F;
+    }
+    short GetPixel(int x, int y) const
+    {
+        if (x >= 0 && x < m_Width && y >= 0 && y < m_Height)
+            return Row(y)[x];
+        return FG_BLACK;
+    }
+
+    // Pixels [x1, x2) x [y1, y2)
+    void DrawRect(int x1, int y1, int x2, int y2, short Color = FG_WHITE)
+    {
+        x1 = std::max(x1, 0);
+        y1 = std::max(y1, 0);
+        x2 = std::min(x2, m_Width);
+        y2 = std::min(y2, m_Height);
+        if (x1 >= x2)
+            return;
+        for (int y = y1; y < y2; ++y)
+            std::fill(Row(y) + x1, Row(y) + x2, (uint8_t)(Color & 0x0F));
+    }
+
+    void DrawLine(int x1, int y1, int x2, int y2, short Color = FG_WHITE)
+    {
+        int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+        int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+        int error = dx + dy;
+        while (true)
+        {
+            DrawPixel(x1, y1, Color);
+            if (x1 == x2 && y1 == y2)
+                break;
+            int e2 = 2 * error;
+            if (e2 >= dy) { error += dy; x1 += sx; }
+            if (e2 <= dx) { error += dx; y1 += sy; }
+        }
+    }
+
+    void DrawFillCircle(int X, int Y, int R, short Color = FG_WHITE)
+    {
+        for (int y = -R; y <= R; ++y)
+        {
+            // Widest half width of the row inside the circle
+            int half = 0;
+            while ((half + 1) * (half + 1) + y * y <= R * R)
+                ++half;
+            if (Y + y >= 0 && Y + y < m_Height)
+                DrawRect(X - half, Y + y, X + half + 1, Y + y + 1, Color);
+        }
+    }
+
+    // Copy Width x Height image of colors with top left pixel at (x,y), Key color is skipped if not negative
+    void DrawImage(int x, int y, const uint8_t* Colors, int Width, int Height, int Key = -1)
+    {
+        const int begin_x = std::max(x, 0), end_x = std::min(x + Width, m_Width);
+        const int begin_y = std::max(y, 0), end_y = std::min(y + Height, m_Height);
+        for (int py = begin_y; py < end_y; ++py)
+        {
+            uint8_t* row = Row(py);
+            const uint8_t* source = Colors + (size_t)(py - y) * Width - x;
+            for (int px = begin_x; px < end_x; ++px)
+                if (source[px] != Key)
+                    row[px] = source[px] & 0x0F;
+        }
+    }
+
+    /* Resolve */
+public:
+    ///<summary> Convert pixels to cells of Target with top left cell at (x,y), clipped by its clip rect </summary>
+    void Resolve(RenderTarget& Target, int x = 0, int y = 0)
+    {
+        const ClipRect& clip = Target.Clip();
+        const int begin_x = std::max(x, clip.Left), end_x = std::min(x + m_Columns, clip.Right);
+        const int begin_y = std::max(y, clip.Top), end_y = std::min(y + m_Rows, clip.Bottom);
+        if (begin_x >= end_x)
+            return;
+
+        if (m_Mode == SUBCELL_MODE::QUADRANT && m_Quadrants.empty())
+            BuildQuadrants();
+
+        for (int cy = begin_y; cy < end_y; ++cy)
+        {
+            const int row = cy - y;
+            const uint8_t* top = Row(row * 2);
+            const uint8_t* bottom = Row(row * 2 + 1);
+            Pixel* out = Target.Row(cy) + begin_x;
+            if (m_Mode == SUBCELL_MODE::HALF_BLOCK)
+                ResolveHalfBlocks(out, top + (begin_x - x), bottom + (begin_x - x), end_x - begin_x);
+            else
+                ResolveQuadrants(out, top + (begin_x - x) * 2, bottom + (begin_x - x) * 2, end_x - begin_x);
+            Target.CountWrites(out, end_x - begin_x);
+        }
+    }
+
+private:
+    static constexpr short UpperHalf = 0x2580;
+
+    static void ResolveHalfBlocks(Pixel* Out, const uint8_t* Top, const uint8_t* Bottom, int Length)
+    {
+        int i = 0;
+#ifdef CE_SIMD_SSE2
+        // 16 cells at once: colors are 4 bit, so attributes are Top | Bottom << 4 in every byte,
+        // then bytes widen to 16 bits and interleave with the glyph into 4 byte pixels
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i glyph = _mm_set1_epi16(UpperHalf);
+        for (; i + 16 <= Length; i += 16)
+        {
+            __m128i top = _mm_loadu_si128((const __m128i*)(Top + i));
+            __m128i bottom = _mm_loadu_si128((const __m128i*)(Bottom + i));
+            __m128i attributes = _mm_or_si128(top, _mm_slli_epi16(bottom, 4));
+            __m128i low = _mm_unpacklo_epi8(attributes, zero);
+            __m128i high = _mm_unpackhi_epi8(attributes, zero);
+            _mm_storeu_si128((__m128i*)(Out + i), _mm_unpacklo_epi16(glyph, low));
+            _mm_storeu_si128((__m128i*)(Out + i + 4), _mm_unpackhi_epi16(glyph, low));
+            _mm_storeu_si128((__m128i*)(Out + i + 8), _mm_unpacklo_epi16(glyph, high));
+            _mm_storeu_si128((__m128i*)(Out + i + 12), _mm_unpackhi_epi16(glyph, high));
+        }
+#endif
+        for (; i < Length; ++i)
+        {
+            Out[i].Char.UnicodeChar = UpperHalf;
+            Out[i].Attributes = Top[i] | (Bottom[i] << 4);
+        }
+    }
+
+    // Four colors of the cell as 16 bit key: top left, top right, bottom left, bottom right nibbles
+    void ResolveQuadrants(Pixel* Out, const uint8_t* Top, const uint8_t* Bottom, int Length) const
+    {
+        const Pixel* table = m_Quadrants.data();
+        int i = 0;
+#ifdef CE_SIMD_SSE2
+        // 8 cells at once: every 16 bit lane holds the left pixel in the low byte and the right one
+        // in the high byte, so (lane | lane >> 4) & 0xFF packs both colors into one byte
+        const __m128i low_byte = _mm_set1_epi16(0x00FF);
+        alignas(16) uint16_t keys[8];
+        for (; i + 8 <= Length; i += 8)
+        {
+            __m128i top = _mm_loadu_si128((const __m128i*)(Top + i * 2));
+            __m128i bottom = _mm_loadu_si128((const __m128i*)(Bottom + i * 2));
+            top = _mm_and_si128(_mm_or_si128(top, _mm_srli_epi16(top, 4)), low_byte);
+            bottom = _mm_and_si128(_mm_or_si128(bottom, _mm_srli_epi16(bottom, 4)), low_byte);
+            _mm_store_si128((__m128i*)keys, _mm_or_si128(top, _mm_slli_epi16(bottom, 8)));
+            for (int k = 0; k < 8; ++k)
+                Out[i + k] = table[keys[k]];
+        }
+#endif
+        for (; i < Length; ++i)
+        {
+            int key = Top[i * 2] | (Top[i * 2 + 1] << 4) | (Bottom[i * 2] << 8) | (Bottom[i * 2 + 1] << 12);
+            Out[i] = table[key];
+        }
+    }
+
+    // Best cell for every combination of four colors, built on first quadrant resolve
+    void BuildQuadrants()
+    {
+        // Glyph by mask of foreground quarters: 1 top left, 2 top right, 4 bottom left, 8 bottom right
+        static const short Glyphs[16] =
+        {
+            L' ', 0x2598, 0x259D, 0x2580, 0x2596, 0x258C, 0x259E, 0x259B,
+            0x2597, 0x259A, 0x2590, 0x259C, 0x2584, 0x2599, 0x259F, 0x2588
+        };
+
+        int distance[16][16];
+        for (int a = 0; a < 16; ++a)
+            for (int b = 0; b < 16; ++b)
+            {
+                distance[a][b] = 0;
+                for (int shift = 0; shift < 24; shift += 8)
+                {
+                    int d = (int)((m_Palette[a] >> shift) & 0xFF) - (int)((m_Palette[b] >> shift) & 0xFF);
+                    distance[a][b] += d * d;
+                }
+            }
+
+        m_Quadrants.resize(1 << 16);
+        for (int key = 0; key < (1 << 16); ++key)
+        {
+            const int colors[4] = { key & 0xF, (key >> 4) & 0xF, (key >> 8) & 0xF, key >> 12 };
+
+            // Try every pair of the cell's colors, pixels take the nearer one of the pair
+            int best = INT_MAX, best_fg = colors[0], best_bg = colors[0], best_mask = 0;
+            for (int i = 0; i < 4 && best != 0; ++i)
+                for (int j = i; j < 4; ++j)
+                {
+                    const int fg = colors[i], bg = colors[j];
+                    int error = 0, mask = 0;
+                    for (int p = 0; p < 4; ++p)
+                    {
+                        if (distance[colors[p]][fg] < distance[colors[p]][bg])
+                            mask |= 1 << p;
+                        error += std::min(distance[colors[p]][fg], distance[colors[p]][bg]);
+                    }
+                    if (error < best)
+                    {
+                        best = error;
+                        best_fg = fg;
+                        best_bg = bg;
+                        best_mask = mask;
+                    }
+                }
+
+            // Single color cells are spaces, so neighbours of the same color look the same
+            if (best_mask == 0 || best_fg == best_bg)
+            {
+                best_mask = 0;
+                best_fg = best_bg;
+            }
+            Pixel& cell = m_Quadrants[key];
+            cell.Char.UnicodeChar = Glyphs[best_mask];
+            cell.Attributes = (short)(best_fg | (best_bg << 4));
+        }
+    }
+
+    std::vector<uint8_t> m_Pixels;
+    SUBCELL_MODE m_Mode = SUBCELL_MODE::HALF_BLOCK;
+    int m_Width = 0, m_Height = 0;
+    int m_Columns = 0, m_Rows = 0;
+
+    uint32_t m_Palette[16];
+    std::vector<Pixel> m_Quadrants;     // Key of four colors -> cell, empty until needed
+};
@@ -0,0 +1,610 @@
+#pragma once
+
+#include <stf/Widgets.h>
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#define CE_EDITOR_TAB_SIZE 4        // Spaces inserted by Tab key
+
+///<summary> Piece table text: original text is never copied, inserted text is appended to one buffer </summary>
+///<remarks> Pieces are kept in a treap with sums of lengths and line breaks, so edits and line lookups
+///          are O(log pieces) and don't depend on the size of the text </remarks>
+class TextDocument
+{
+public:
+    TextDocument() = default;
+    explicit TextDocument(std::wstring Text) { Load(std::move(Text)); }
+
+    // Replace the whole text, "\r\n" line endings become "\n"
+    void Load(std::wstring Text)
+    {
+        Text.erase(std::remove(Text.begin(), Text.end(), L'\r'), Text.end());
+        m_Buffers[ORIGINAL].Text = std::move(Text);
+        m_Buffers[ADDED].Text.clear();
+        for (Buffer& buffer : m_Buffers)
+        {
+            buffer.Newlines.clear();
+            for (size_t i = 0; i < buffer.Text.size(); ++i)
+                if (buffer.Text[i] == L'\n')
+                    buffer.Newlines.push_back(i);
+        }
+
+        m_Nodes.clear();
+        m_Free.clear();
+        m_Root = Nil;
+        if (!m_Buffers[ORIGINAL].Text.empty())
+            m_Root = NewNode(ORIGINAL, 0, m_Buffers[ORIGINAL].Text.size());
+    }
+
+    size_t Length() const { return Size(m_Root); }
+    // Lines are separated by '\n', so empty text has one line
+    size_t LineCount() const { return Lines(m_Root) + 1; }
+    size_t PieceCount() const { return m_Nodes.size() - m_Free.size(); }
+
+    /* Editing */
+public:
+    void Insert(size_t Offset, const wchar_t* Text, size_t Count)
+    {
+        if (Count == 0)
+            return;
+        Offset = std::min(Offset, Length());
+
+        Buffer& added = m_Buffers[ADDED];
+        const size_t start = added.Text.size();
+        const size_t newlines_before = added.Newlines.size();
+        for (size_t i = 0; i < Count; ++i)
+            if (Text[i] == L'\n')
+                added.Newlines.push_back(start + i);
+        added.Text.append(Text, Count);
+        const size_t newlines = added.Newlines.size() - newlines_before;
+
+        uint32_t left, right;
+        Split(m_Root, Offset, left, right);
+        // Typing continues the piece of the previous insert instead of adding a new one
+        if (left == Nil || !ExtendLast(left, start, Count, newlines))
+            left = Merge(left, NewNode(ADDED, start, Count));
+        m_Root = Merge(left, right);
+    }
+    void Insert(size_t Offset, const std::wstring& Text) { Insert(Offset, Text.c_str(), Text.size()); }
+
+    void Erase(size_t Offset, size_t Count)
+    {
+        if (Offset >= Length() || Count == 0)
+            return;
+        uint32_t left, middle, right;
+        Split(m_Root, Offset, left, right);
+        Split(right, Count, middle, right);
+        FreeTree(middle);
+        m_Root = Merge(left, right);
+    }
+
+    /* Lookup */
+public:
+    // Offset of the first character of the line, Length() for lines past the end
+    size_t LineStart(size_t Line) const
+    {
+        if (Line == 0)
+            return 0;
+        // Find the Line-th line break, the line starts right after it
+        size_t offset = 0;
+        for (uint32_t n = m_Root; n != Nil;)
+        {
+            const Node& node = m_Nodes[n];
+            const size_t left_lines = Lines(node.Left);
+            if (Line <= left_lines)
+            {
+                n = node.Left;
+                continue;
+            }
+            offset += Size(node.Left);
+            if (Line <= left_lines + node.Newlines)
+            {
+                const std::vector<size_t>& newlines = m_Buffers[node.Buffer].Newlines;
+                const size_t first = std::lower_bound(newlines.begin(), newlines.end(), node.Start) - newlines.begin();
+                return offset + newlines[first + (Line - left_lines) - 1] - node.Start + 1;
+            }
+            Line -= left_lines + node.Newlines;
+            offset += node.Length;
+            n = node.Right;
+        }
+        return Length();
+    }
+    // Length of the line without '\n'
+    size_t LineLength(size_t Line) const
+    {
+        const size_t start = LineStart(Line);
+        const size_t end = Line + 1 < LineCount() ? LineStart(Line + 1) - 1 : Length();
+        return end > start ? end - start : 0;
+    }
+    // Line that contains Offset
+    size_t LineOf(size_t Offset) const
+    {
+        size_t line = 0;
+        for (uint32_t n = m_Root; n != Nil;)
+        {
+            const Node& node = m_Nodes[n];
+            const size_t left = Size(node.Left);
+            if (Offset < left)
+            {
+                n = node.Left;
+                continue;
+            }
+            line += Lines(node.Left);
+            if (Offset < left + node.Length)
+                return line + CountNewlines(node.Buffer, node.Start, Offset - left);
+            line += node.Newlines;
+            Offset -= left + node.Length;
+            n = node.Right;
+        }
+        return line;
+    }
+
+    ///<summary> Call Func(const wchar_t* Text, size_t Length) for every continuous part of the range </summary>
+    template < typename SpanFunc >
+    void ForEachSpan(size_t Offset, size_t Count, SpanFunc&& Func) const
+    {
+        Visit(m_Root, 0, Offset, Offset + std::min(Count, Length() - std::min(Offset, Length())), Func);
+    }
+    // Copy range into Out, its memory is reused
+    void Read(size_t Offset, size_t Count, std::wstring& Out) const
+    {
+        Out.clear();
+        ForEachSpan(Offset, Count, [&Out](const wchar_t* Text, size_t Length) { Out.append(Text, Length); });
+    }
+    std::wstring Text() const
+    {
+        std::wstring result;
+        result.reserve(Length());
+        Read(0, Length(), result);
+        return result;
+    }
+    wchar_t At(size_t Offset) const
+    {
+        wchar_t result = 0;
+        ForEachSpan(Offset, 1, [&result](const wchar_t* Text, size_t) { result = *Text; });
+        return result;
+    }
+
+private:
+    static constexpr uint32_t Nil = UINT32_MAX;
+    enum : uint8_t { ORIGINAL = 0, ADDED = 1 };
+
+    struct Buffer
+    {
+        std::wstring Text;
+        std::vector<size_t> Newlines;       // Positions of '\n', always sorted
+    };
+
+    struct Node
+    {
+        uint32_t Left = Nil, Right = Nil;
+        uint32_t Priority = 0;
+        uint8_t Buffer = ORIGINAL;
+        size_t Start = 0, Length = 0, Newlines = 0;     // The piece
+        size_t TotalLength = 0, TotalNewlines = 0;      // Sums of the subtree
+    };
+
+    size_t Size(uint32_t n) const { return n == Nil ? 0 : m_Nodes[n].TotalLength; }
+    size_t Lines(uint32_t n) const { return n == Nil ? 0 : m_Nodes[n].TotalNewlines; }
+
+    size_t CountNewlines(uint8_t BufferIndex, size_t Start, size_t Length) const
+    {
+        const std::vector<size_t>& newlines = m_Buffers[BufferIndex].Newlines;
+        return std::lower_bound(newlines.begin(), newlines.end(), Start + Length) - std::lower_bound(newlines.begin(), newlines.end(), Start);
+    }
+
+    uint32_t NewNode(uint8_t BufferIndex, size_t Start, size_t Length)
+    {
+        uint32_t n;
+        if (!m_Free.empty())
+        {
+            n = m_Free.back();
+            m_Free.pop_back();
+            m_Nodes[n] = Node();
+        }
+        else
+        {
+            n = (uint32_t)m_Nodes.size();
+            m_Nodes.emplace_back();
+        }
+        // Xorshift is enough for balancing
+        m_Seed ^= m_Seed << 13;
+        m_Seed ^= m_Seed >> 17;
+        m_Seed ^= m_Seed << 5;
+
+        Node& node = m_Nodes[n];
+        node.Priority = m_Seed;
+        node.Buffer = BufferIndex;
+        node.Start = Start;
+        node.Length = Length;
+        node.Newlines = CountNewlines(BufferIndex, Start, Length);
+        Update(n);
+        return n;
+    }
+    void FreeTree(uint32_t n)
+    {
+        if (n == Nil)
+            return;
+        FreeTree(m_Nodes[n].Left);
+        FreeTree(m_Nodes[n].Right);
+        m_Free.push_back(n);
+    }
+
+    void Update(uint32_t n)
+    {
+        Node& node = m_Nodes[n];
+        node.TotalLength = node.Length + Size(node.Left) + Size(node.Right);
+        node.TotalNewlines = node.Newlines + Lines(node.Left) + Lines(node.Right);
+    }
+
+    // Nodes are addressed by index, so no references are kept over calls that may add nodes
+    uint32_t Merge(uint32_t a, uint32_t b)
+    {
+        if (a == Nil)
+            return b;
+        if (b == Nil)
+            return a;
+        if (m_Nodes[a].Priority > m_Nodes[b].Priority)
+        {
+            uint32_t right = Merge(m_Nodes[a].Right, b);
+            m_Nodes[a].Right = right;
+            Update(a);
+            return a;
+        }
+        uint32_t left = Merge(a, m_Nodes[b].Left);
+        m_Nodes[b].Left = left;
+        Update(b);
+        return b;
+    }
+
+    // First Offset characters go to Left, piece in the middle of the cut is split in two
+    void Split(uint32_t n, size_t Offset, uint32_t& Left, uint32_t& Right)
+    {
+        if (n == Nil)
+        {
+            Left = Right = Nil;
+            return;
+        }
+        const size_t left_size = Size(m_Nodes[n].Left);
+        if (Offset <= left_size)
+        {
+            uint32_t inner;
+            Split(m_Nodes[n].Left, Offset, Left, inner);
+            m_Nodes[n].Left = inner;
+            Update(n);
+            Right = n;
+        }
+        else if (Offset >= left_size + m_Nodes[n].Length)
+        {
+            uint32_t inner;
+            Split(m_Nodes[n].Right, Offset - left_size - m_Nodes[n].Length, inner, Right);
+            m_Nodes[n].Right = inner;
+            Update(n);
+            Left = n;
+        }
+        else
+        {
+            const size_t cut = Offset - left_size;
+            const Node piece = m_Nodes[n];
+            uint32_t tail = NewNode(piece.Buffer, piece.Start + cut, piece.Length - cut);
+            Node& node = m_Nodes[n];
+            node.Length = cut;
+            node.Newlines = piece.Newlines - m_Nodes[tail].Newlines;
+            node.Right = Nil;
+            Update(n);
+            Left = n;
+            Right = Merge(tail, piece.Right);
+        }
+    }
+
+    // Grow the last piece of the tree if the added text directly follows it
+    bool ExtendLast(uint32_t n, size_t AddedStart, size_t Count, size_t Newlines)
+    {
+        bool extended;
+        const uint32_t right = m_Nodes[n].Right;
+        if (right != Nil)
+            extended = ExtendLast(right, AddedStart, Count, Newlines);
+        else
+        {
+            Node& node = m_Nodes[n];
+            extended = node.Buffer == ADDED && node.Start + node.Length == AddedStart;
+            if (extended)
+            {
+                node.Length += Count;
+                node.Newlines += Newlines;
+            }
+        }
+        if (extended)
+            Update(n);
+        return extended;
+    }
+
+    // In order walk that skips subtrees outside [From, To)
+    template < typename SpanFunc >
+    void Visit(uint32_t n, size_t Base, size_t From, size_t To, SpanFunc& Func) const
+    {
+        if (n == Nil || Base >= To || Base + Size(n) <= From)
+            return;
+        const Node& node = m_Nodes[n];
+        Visit(node.Left, Base, From, To, Func);
+        const size_t piece_start = Base + Size(node.Left), piece_end = piece_start + node.Length;
+        const size_t begin = std::max(From, piece_start), end = std::min(To, piece_end);
+        if (begin < end)
+            Func(m_Buffers[node.Buffer].Text.data() + node.Start + (begin - piece_start), end - begin);
+        Visit(node.Right, piece_end, From, To, Func);
+    }
+
+    Buffer m_Buffers[2];
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_Free;       // Indices of erased nodes
+    uint32_t m_Root = Nil;
+    uint32_t m_Seed = 0x9E3779B9;
+};
+
+///<summary> Multiline editor widget over TextDocument </summary>
+///<remarks> Only visible lines are read and drawn, an edit redraws the lines it touched, so cost of
+///          a keystroke doesn't depend on the size of the file. Tabs are shown as spaces </remarks>
+class TextEditor : public Widget
+{
+public:
+    explicit TextEditor(short Color = FG_GREY, short GutterColor = FG_DARK_GREY) : m_Color(Color), m_GutterColor(GutterColor) {}
+
+    void Load(std::wstring Text)
+    {
+        m_Document.Load(std::move(Text));
+        m_CursorLine = m_CursorColumn = m_PreferredColumn = 0;
+        m_Top = m_Left = 0;
+        Invalidate();
+    }
+    std::wstring Text() const { return m_Document.Text(); }
+    const TextDocument& Document() const { return m_Document; }
+
+    void SetLineNumbers(bool Enabled)
+    {
+        m_LineNumbers = Enabled;
+        Invalidate();
+    }
+
+    size_t CursorLine() const { return m_CursorLine; }
+    size_t CursorColumn() const { return m_CursorColumn; }
+    void SetCursor(size_t Line, size_t Column)
+    {
+        MarkLines(m_CursorLine, m_CursorLine + 1);
+        m_CursorLine = std::min(Line, m_Document.LineCount() - 1);
+        m_CursorColumn = m_PreferredColumn = std::min(Column, m_Document.LineLength(m_CursorLine));
+        MarkLines(m_CursorLine, m_CursorLine + 1);
+        ScrollToCursor();
+    }
+
+    // Insert at cursor and move cursor after the text
+    void InsertText(const wchar_t* Text, size_t Count)
+    {
+        const size_t lines_before = m_Document.LineCount();
+        const size_t offset = CursorOffset();
+        m_Document.Insert(offset, Text, Count);
+        const size_t line = m_CursorLine;
+        const size_t after = offset + Count;
+        m_CursorLine = m_Document.LineOf(after);
+        m_CursorColumn = m_PreferredColumn = after - m_Document.LineStart(m_CursorLine);
+        Edited(line, lines_before);
+    }
+    void InsertText(const std::wstring& Text) { InsertText(Text.c_str(), Text.size()); }
+
+    std::function<void()> OnChange;
+
+    bool Focusable() const override { return true; }
+    void OnFocus(bool) override { MarkLines(m_CursorLine, m_CursorLine + 1); }
+
+    bool OnKey(KEY Key, wchar_t Character) override
+    {
+        const size_t page = (size_t)std::max(Rect().Height - 1, 1);
+        switch (Key)
+        {
+        case KEY::LEFT:
+            if (m_CursorColumn > 0)
+                SetCursor(m_CursorLine, m_CursorColumn - 1);
+            else if (m_CursorLine > 0)
+                SetCursor(m_CursorLine - 1, m_Document.LineLength(m_CursorLine - 1));
+            return true;
+        case KEY::RIGHT:
+            if (m_CursorColumn < m_Document.LineLength(m_CursorLine))
+                SetCursor(m_CursorLine, m_CursorColumn + 1);
+            else if (m_CursorLine + 1 < m_Document.LineCount())
+                SetCursor(m_CursorLine + 1, 0);
+            return true;
+        case KEY::UP: MoveVertically(m_CursorLine > 0 ? m_CursorLine - 1 : 0); return true;
+        case KEY::DOWN: MoveVertically(m_CursorLine + 1); return true;
+        case KEY::PAGE_UP: MoveVertically(m_CursorLine > page ? m_CursorLine - page : 0); return true;
+        case KEY::PAGE_DOWN: MoveVertically(m_CursorLine + page); return true;
+        case KEY::HOME: SetCursor(m_CursorLine, 0); return true;
+        case KEY::END: SetCursor(m_CursorLine, m_Document.LineLength(m_CursorLine)); return true;
+        case KEY::ENTER: InsertText(L"\n", 1); return true;
+        case KEY::TAB: InsertText(std::wstring(CE_EDITOR_TAB_SIZE, L' ')); return true;
+        case KEY::BACKSPACE:
+        {
+            const size_t offset = CursorOffset();
+            if (offset == 0)
+                return true;
+            // Cursor goes to the erased character first, so line join is handled the same way
+            if (m_CursorColumn > 0)
+                m_CursorColumn--;
+            else
+            {
+                m_CursorLine--;
+                m_CursorColumn = m_Document.LineLength(m_CursorLine);
+            }
+            EraseAtCursor();
+            return true;
+        }
+        case KEY::DEL:
+            if (CursorOffset() < m_Document.Length())
+                EraseAtCursor();
+            return true;
+        default:
+            if (!Character)
+                return false;
+            InsertText(&Character, 1);
+            return true;
+        }
+    }
+    bool OnClick(int x, int y) override
+    {
+        SetCursor(m_Top + y, m_Left + std::max(x - GutterWidth(), 0));
+        return true;
+    }
+    bool OnWheel(int Notches) override
+    {
+        size_t step = (size_t)std::abs(Notches) * 3;
+        ScrollTo(Notches > 0 ? (m_Top > step ? m_Top - step : 0) : std::min(m_Top + step, m_Document.LineCount() - 1), m_Left);
+        return true;
+    }
+
+protected:
+    void Render(Canvas& Target) override
+    {
+        m_GutterDigits = GutterDigits();
+        m_DirtyFrom = m_DirtyTo = 0;
+        for (int row = 0; row < Rect().Height; ++row)
+            RenderLine(Target, m_Top + row);
+    }
+    void RenderChanges(Canvas& Target) override
+    {
+        const size_t end = std::min(m_DirtyTo, m_Top + (size_t)std::max(Rect().Height, 0));
+        for (size_t line = std::max(m_DirtyFrom, m_Top); line < end; ++line)
+            RenderLine(Target, line);
+        m_DirtyFrom = m_DirtyTo = 0;
+    }
+
+private:
+    size_t CursorOffset() const { return m_Document.LineStart(m_CursorLine) + m_CursorColumn; }
+
+    void EraseAtCursor()
+    {
+        const size_t lines_before = m_Document.LineCount();
+        m_Document.Erase(CursorOffset(), 1);
+        m_PreferredColumn = m_CursorColumn;
+        Edited(m_CursorLine, lines_before);
+    }
+
+    // Lines below the edit move only if count of lines changed
+    void Edited(size_t Line, size_t LinesBefore)
+    {
+        const size_t lines = m_Document.LineCount();
+        MarkLines(Line, lines != LinesBefore ? std::max(lines, LinesBefore) : Line + 1);
+        MarkLines(m_CursorLine, m_CursorLine + 1);
+        if (GutterDigits() != m_GutterDigits)
+            Invalidate();
+        ScrollToCursor();
+        if (OnChange)
+            OnChange();
+    }
+
+    void MoveVertically(size_t Line)
+    {
+        const size_t column = m_PreferredColumn;
+        SetCursor(Line, column);
+        m_PreferredColumn = column;
+    }
+
+    void MarkLines(size_t From, size_t To)
+    {
+        if (m_DirtyFrom == m_DirtyTo)
+        {
+            m_DirtyFrom = From;
+            m_DirtyTo = To;
+        }
+        else
+        {
+            m_DirtyFrom = std::min(m_DirtyFrom, From);
+            m_DirtyTo = std::max(m_DirtyTo, To);
+        }
+        InvalidateChanges();
+    }
+
+    void ScrollToCursor()
+    {
+        const size_t rows = (size_t)std::max(Rect().Height, 1);
+        const size_t columns = (size_t)std::max(Rect().Width - GutterWidth(), 1);
+        size_t top = m_Top, left = m_Left;
+        if (m_CursorLine < top)
+            top = m_CursorLine;
+        else if (m_CursorLine >= top + rows)
+            top = m_CursorLine - rows + 1;
+        if (m_CursorColumn < left)
+            left = m_CursorColumn;
+        else if (m_CursorColumn >= left + columns)
+            left = m_CursorColumn - columns + 1;
+        ScrollTo(top, left);
+    }
+    void ScrollTo(size_t Top, size_t Left)
+    {
+        if (Top != m_Top || Left != m_Left)
+        {
+            m_Top = Top;
+            m_Left = Left;
+            Invalidate();
+        }
+    }
+
+    int GutterDigits() const
+    {
+        if (!m_LineNumbers)
+            return 0;
+        int digits = 1;
+        for (size_t count = m_Document.LineCount(); count >= 10; count /= 10)
+            ++digits;
+        return digits;
+    }
+    int GutterWidth() const { return m_LineNumbers ? m_GutterDigits + 1 : 0; }
+
+    // Only the visible part of the line is read from the document
+    void RenderLine(Canvas& Target, size_t Line)
+    {
+        const WidgetRect& r = Rect();
+        const int y = r.y + (int)(Line - m_Top);
+        const int gutter = GutterWidth();
+        const int width = r.Width - gutter;
+        const bool exists = Line < m_Document.LineCount();
+
+        if (gutter > 0)
+        {
+            std::wstring number = exists ? std::to_wstring(Line + 1) : std::wstring();
+            number.insert(0, (size_t)std::max(m_GutterDigits - (int)number.size(), 0), L' ');
+            DrawText(Target, r.x, y, gutter, number, m_GutterColor | Background());
+        }
+        if (width <= 0)
+            return;
+
+        m_Line.clear();
+        if (exists)
+        {
+            const size_t length = m_Document.LineLength(Line);
+            if (m_Left < length)
+                m_Document.Read(m_Document.LineStart(Line) + m_Left, std::min(length - m_Left, (size_t)width), m_Line);
+            std::replace(m_Line.begin(), m_Line.end(), L'\t', L' ');
+        }
+        DrawText(Target, r.x + gutter, y, width, m_Line, m_Color | Background());
+
+        if (Focused() && Line == m_CursorLine && m_CursorColumn >= m_Left && m_CursorColumn < m_Left + width)
+        {
+            const size_t column = m_CursorColumn - m_Left;
+            const wchar_t under = column < m_Line.size() ? m_Line[column] : L' ';
+            const short color = m_Color | Background();
+            Target.DrawPixel(r.x + gutter + (int)column, y, under, (short)(((color & 0x0F) << 4) | ((color & 0xF0) >> 4)));
+        }
+    }
+
+    TextDocument m_Document;
+    size_t m_CursorLine = 0, m_CursorColumn = 0;
+    size_t m_PreferredColumn = 0;       // Column kept while moving up and down over short lines
+    size_t m_Top = 0, m_Left = 0;       // First visible line and column
+    size_t m_DirtyFrom = 0, m_DirtyTo = 0;
+    bool m_LineNumbers = true;
+    int m_GutterDigits = 1;
+    short m_Color;
+    short m_GutterColor;
+    std::wstring m_Line;                // Visible part of the line being drawn, reused
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stf/ConsoleEngine.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+// Size of the chunk side as power of two (32x32 cells by default)
+#define CE_TILEMAP_CHUNK_SHIFT 5
+
+// Viewport into the world: which world cell is shown at which screen position
+struct Camera
+{
+    iVec2 Position;         // World cell that shown at the top left corner of the viewport
+    iVec2 Offset;           // Top left corner of the viewport on the screen
+    iVec2 Size;             // Viewport size in cells, zero means the whole screen
+
+    // Move camera so the world cell appears at the center of the viewport
+    void CenterOn(iVec2 WorldPoint, iVec2 ViewSize)
+    {
+        Position = { WorldPoint.x - ViewSize.x / 2, WorldPoint.y - ViewSize.y / 2 };
+    }
+
+    iVec2 WorldToScreen(iVec2 WorldPoint) const
+    {
+        return { WorldPoint.x - Position.x + Offset.x, WorldPoint.y - Position.y + Offset.y };
+    }
+    iVec2 ScreenToWorld(iVec2 ScreenPoint) const
+    {
+        return { ScreenPoint.x - Offset.x + Position.x, ScreenPoint.y - Offset.y + Position.y };
+    }
+};
+
+/* Sparse chunked tilemap, chunks allocated on first write */
+class TileMap
+{
+public:
+    static constexpr int ChunkSize = 1 << CE_TILEMAP_CHUNK_SHIFT;
+    static constexpr int ChunkMask = ChunkSize - 1;
+
+    struct Chunk
+    {
+        Pixel Cells[ChunkSize * ChunkSize];
+    };
+
+    // Empty tile returned for cells of not allocated chunks and used to fill new chunks
+    TileMap(Pixel Empty = {}) : m_Empty(Empty) {}
+
+    void SetTile(int x, int y, Pixel Tile)
+    {
+        GetOrCreateChunk(x >> CE_TILEMAP_CHUNK_SHIFT, y >> CE_TILEMAP_CHUNK_SHIFT)
+            .Cells[(y & ChunkMask) * ChunkSize + (x & ChunkMask)] = Tile;
+    }
+    void SetTile(int x, int y, short Character, short Color)
+    {
+        Pixel Tile;
+        Tile.Char.UnicodeChar = Character;
+        Tile.Attributes = Color;
+        SetTile(x, y, Tile);
+    }
+    void SetTile(iVec2 Point, Pixel Tile)
+    {
+        SetTile(Point.x, Point.y, Tile);
+    }
+
+    Pixel GetTile(int x, int y) const
+    {
+        const Chunk* chunk = FindChunk(x >> CE_TILEMAP_CHUNK_SHIFT, y >> CE_TILEMAP_CHUNK_SHIFT);
+        if (!chunk)
+            return m_Empty;
+        return chunk->Cells[(y & ChunkMask) * ChunkSize + (x & ChunkMask)];
+    }
+    Pixel GetTile(iVec2 Point) const { return GetTile(Point.x, Point.y); }
+
+    // Fill rect [x1, x2) x [y1, y2) chunk by chunk, so every chunk looked up once
+    void Fill(int x1, int y1, int x2, int y2, Pixel Tile)
+    {
+        if (x1 >= x2 || y1 >= y2)
+            return;
+
+        for (int cy = y1 >> CE_TILEMAP_CHUNK_SHIFT; cy <= (y2 - 1) >> CE_TILEMAP_CHUNK_SHIFT; ++cy)
+            for (int cx = x1 >> CE_TILEMAP_CHUNK_SHIFT; cx <= (x2 - 1) >> CE_TILEMAP_CHUNK_SHIFT; ++cx)
+            {
+                Chunk& chunk = GetOrCreateChunk(cx, cy);
+                int from_x = std::max(x1, cx * ChunkSize), to_x = std::min(x2, (cx + 1) * ChunkSize);
+                int from_y = std::max(y1, cy * ChunkSize), to_y = std::min(y2, (cy + 1) * ChunkSize);
+                for (int y = from_y; y < to_y; ++y)
+                {
+                    Pixel* row = chunk.Cells + (y & ChunkMask) * ChunkSize;
+                    for (int x = from_x; x < to_x; ++x)
+                        row[x & ChunkMask] = Tile;
+                }
+            }
+    }
+
+    // Release chunk memory, its cells become empty
+    void EraseChunk(int chunk_x, int chunk_y)
+    {
+        m_Chunks.erase(ChunkKey(chunk_x, chunk_y));
+    }
+    void Clear()
+    {
+        m_Chunks.clear();
+    }
+
+    const Chunk* FindChunk(int chunk_x, int chunk_y) const
+    {
+        auto it = m_Chunks.find(ChunkKey(chunk_x, chunk_y));
+        return it != m_Chunks.end() ? it->second.get() : nullptr;
+    }
+    Chunk* FindChunk(int chunk_x, int chunk_y)
+    {
+        auto it = m_Chunks.find(ChunkKey(chunk_x, chunk_y));
+        return it != m_Chunks.end() ? it->second.get() : nullptr;
+    }
+
+    size_t ChunkCount() const { return m_Chunks.size(); }
+    const Pixel& EmptyTile() const { return m_Empty; }
+
+    ///<summary> Blit visible part of the map through the camera viewport </summary>
+    ///<remarks> Only chunks intersecting the viewport are visited and each chunk row copied
+    /// as one clipped span, so cost depends on viewport size, not on the world size.
+    /// Cells of not allocated chunks are left untouched. </remarks>
+    void Draw(ConsoleEngine& Engine, const Camera& View) const
+    {
+        // Viewport rect on the screen clipped by screen bounds
+        int size_x = View.Size.x > 0 ? View.Size.x : Engine.ScreenWidth();
+        int size_y = View.Size.y > 0 ? View.Size.y : Engine.ScreenHeight();
+        int screen_x1 = std::max(View.Offset.x, 0);
+        int screen_y1 = std::max(View.Offset.y, 0);
+        int screen_x2 = std::min(View.Offset.x + size_x, Engine.ScreenWidth());
+        int screen_y2 = std::min(View.Offset.y + size_y, Engine.ScreenHeight());
+        if (screen_x1 >= screen_x2 || screen_y1 >= screen_y2)
+            return;
+
+        // Same rect in world cells
+        iVec2 world1 = View.ScreenToWorld({ screen_x1, screen_y1 });
+        iVec2 world2 = View.ScreenToWorld({ screen_x2, screen_y2 });
+
+        for (int cy = world1.y >> CE_TILEMAP_CHUNK_SHIFT; cy <= (world2.y - 1) >> CE_TILEMAP_CHUNK_SHIFT; ++cy)
+        {
+            int from_y = std::max(world1.y, cy * ChunkSize), to_y = std::min(world2.y, (cy + 1) * ChunkSize);
+            for (int cx = world1.x >> CE_TILEMAP_CHUNK_SHIFT; cx <= (world2.x - 1) >> CE_TILEMAP_CHUNK_SHIFT; ++cx)
+            {
+                const Chunk* chunk = FindChunk(cx, cy);
+                if (!chunk)
+                    continue;
+
+                int from_x = std::max(world1.x, cx * ChunkSize), to_x = std::min(world2.x, (cx + 1) * ChunkSize);
+                iVec2 screen = View.WorldToScreen({ from_x, from_y });
+                for (int y = from_y; y < to_y; ++y, ++screen.y)
+                    Engine.DrawSpan(screen.x, screen.y, chunk->Cells + (y & ChunkMask) * ChunkSize + (from_x & ChunkMask), to_x - from_x);
+            }
+        }
+    }
+
+private:
+    static uint64_t ChunkKey(int chunk_x, int chunk_y)
+    {
+        return ((uint64_t)(uint32_t)chunk_y << 32) | (uint32_t)chunk_x;
+    }
+
+    Chunk& GetOrCreateChunk(int chunk_x, int chunk_y)
+    {
+        std::unique_ptr<Chunk>& chunk = m_Chunks[ChunkKey(chunk_x, chunk_y)];
+        if (!chunk)
+        {
+            chunk.reset(new Chunk);
+            for (Pixel& cell : chunk->Cells)
+                cell = m_Empty;
+        }
+        return *chunk;
+    }
+
+    Pixel m_Empty;
+    std::unordered_map<uint64_t, std::unique_ptr<Chunk>> m_Chunks;
+};
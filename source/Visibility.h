@@ -0,0 +1,344 @@
+#pragma once
+
+#include <stf/ShadeBlend.h>
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+#define CE_LIGHT_DIM_LEVELS 4       // Steps of attribute darkening, from full color to black
+
+/* Field of view and lights over a grid of opaque cells, both computed by recursive shadowcasting.
+   Results are cached, Update() recomputes only the viewer and lights that changed or whose
+   radius covers a cell that changed opacity, so moving a few lights costs only their areas */
+class LightGrid
+{
+public:
+    LightGrid() { BuildDimTable(); }
+    LightGrid(int Width, int Height) : LightGrid() { Resize(Width, Height); }
+
+    // Cells become transparent, lights are kept and recomputed
+    void Resize(int Width, int Height)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Opaque.assign((size_t)Width * Height, 0);
+        m_Light.assign((size_t)Width * Height, 0);
+        m_Visible.assign((size_t)Width * Height, 0);
+        for (LightSource& light : m_Lights)
+        {
+            light.Applied = false;
+            light.Dirty = light.Active;
+        }
+        m_ViewerDirty = true;
+    }
+    int Width() const { return m_Width; }
+    int Height() const { return m_Height; }
+
+    /* Opacity */
+public:
+    void SetOpaque(int x, int y, bool Opaque)
+    {
+        if (!Inside(x, y) || (m_Opaque[Index(x, y)] != 0) == Opaque)
+            return;
+        m_Opaque[Index(x, y)] = Opaque;
+        for (LightSource& light : m_Lights)
+            if (light.Active && Covers(light.x, light.y, light.Radius, x, y))
+                light.Dirty = true;
+        if (m_HasViewer && Covers(m_ViewerX, m_ViewerY, m_ViewerRadius, x, y))
+            m_ViewerDirty = true;
+    }
+    // Cells outside of the grid block light and view
+    bool IsOpaque(int x, int y) const { return !Inside(x, y) || m_Opaque[Index(x, y)]; }
+
+    /* Field of view */
+public:
+    void SetViewer(int x, int y, int Radius)
+    {
+        if (m_HasViewer && x == m_ViewerX && y == m_ViewerY && Radius == m_ViewerRadius)
+            return;
+        m_HasViewer = m_ViewerDirty = true;
+        m_ViewerX = x;
+        m_ViewerY = y;
+        m_ViewerRadius = Radius;
+    }
+    // Without viewer every cell is visible
+    void ClearViewer()
+    {
+        m_HasViewer = false;
+        m_ViewerDirty = true;
+    }
+    bool IsVisible(int x, int y) const { return Inside(x, y) && (!m_HasViewer || m_Visible[Index(x, y)]); }
+
+    /* Lights */
+public:
+    ///<summary> Light of Intensity at the center that fades to zero past Radius, returns its id </summary>
+    int AddLight(int x, int y, int Radius, uint8_t Intensity = 255)
+    {
+        size_t id = 0;
+        while (id < m_Lights.size() && m_Lights[id].Active)
+            ++id;
+        if (id == m_Lights.size())
+            m_Lights.emplace_back();
+        LightSource& light = m_Lights[id];
+        light.Active = light.Dirty = true;
+        light.x = x;
+        light.y = y;
+        light.Radius = std::max(Radius, 0);
+        light.Intensity = Intensity;
+        return (int)id;
+    }
+    void MoveLight(int Id, int x, int y)
+    {
+        LightSource& light = m_Lights[Id];
+        if (light.x != x || light.y != y)
+        {
+            light.x = x;
+            light.y = y;
+            light.Dirty = true;
+        }
+    }
+    void SetLight(int Id, int Radius, uint8_t Intensity)
+    {
+        LightSource& light = m_Lights[Id];
+        if (light.Radius != Radius || light.Intensity != Intensity)
+        {
+            light.Radius = std::max(Radius, 0);
+            light.Intensity = Intensity;
+            light.Dirty = true;
+        }
+    }
+    // Id may be returned by the next AddLight()
+    void RemoveLight(int Id)
+    {
+        m_Lights[Id].Active = false;
+        m_Lights[Id].Dirty = true;
+    }
+    // Light of cells without any source
+    void SetAmbient(uint8_t Level) { m_Ambient = Level; }
+
+    // Light level of the cell in [0, 255], as of the last Update()
+    uint8_t Light(int x, int y) const
+    {
+        if (!Inside(x, y))
+            return 0;
+        return (uint8_t)std::min<uint32_t>(m_Light[Index(x, y)] + m_Ambient, 255);
+    }
+
+    ///<summary> Recompute viewer and changed lights, returns count of recomputed lights </summary>
+    int Update()
+    {
+        int updated = 0;
+        for (LightSource& light : m_Lights)
+        {
+            if (!light.Dirty)
+                continue;
+            if (light.Applied)
+                Accumulate(light, false);
+            if (light.Active)
+            {
+                CastLight(light);
+                Accumulate(light, true);
+                ++updated;
+            }
+            light.Dirty = false;
+        }
+        if (m_ViewerDirty)
+            CastView();
+        return updated;
+    }
+
+    ///<summary> Darken cells of Target by light and visibility, grid cell (0,0) is at target (x,y) </summary>
+    ///<param name="Shade"> Blend black over cells with shade glyphs, nullptr darkens colors only </param>
+    ///<remarks> Not visible cells become black. Updates itself first, clipped by target clip rect </remarks>
+    void Apply(RenderTarget& Target, int x, int y, const ShadeCompositor* Shade = nullptr)
+    {
+        Update();
+        const ClipRect& clip = Target.Clip();
+        const int x1 = std::max(x, clip.Left), x2 = std::min(x + m_Width, clip.Right);
+        const int y1 = std::max(y, clip.Top), y2 = std::min(y + m_Height, clip.Bottom);
+        for (int ty = y1; ty < y2; ++ty)
+        {
+            Pixel* row = Target.Row(ty);
+            for (int tx = x1; tx < x2; ++tx)
+            {
+                const int gx = tx - x, gy = ty - y;
+                const int level = m_HasViewer && !m_Visible[Index(gx, gy)] ? 0 : Light(gx, gy);
+                if (level == 255)
+                    continue;
+                if (Shade)
+                    Shade->BlendCell(row[tx], FG_BLACK, (uint8_t)(255 - level));
+                else
+                    Dim(row[tx], level);
+            }
+            if (x1 < x2)
+                Target.CountWrites(row + x1, x2 - x1);
+        }
+    }
+
+private:
+    struct LightSource
+    {
+        int x = 0, y = 0;
+        int Radius = 0;
+        uint8_t Intensity = 0;
+        bool Active = false;
+        bool Dirty = false;
+        bool Applied = false;           // Contribution is added to m_Light
+        int BoxX = 0, BoxY = 0, BoxSize = 0;
+        std::vector<uint8_t> Contribution;  // Light of the box around the source, kept to subtract it later
+    };
+
+    bool Inside(int x, int y) const { return x >= 0 && x < m_Width && y >= 0 && y < m_Height; }
+    size_t Index(int x, int y) const { return (size_t)y * m_Width + x; }
+    static bool Covers(int cx, int cy, int Radius, int x, int y) { return abs(x - cx) <= Radius && abs(y - cy) <= Radius; }
+
+    void CastLight(LightSource& Light)
+    {
+        Light.BoxX = Light.x - Light.Radius;
+        Light.BoxY = Light.y - Light.Radius;
+        Light.BoxSize = 2 * Light.Radius + 1;
+        Light.Contribution.assign((size_t)Light.BoxSize * Light.BoxSize, 0);
+        const float fade = 1.0f / (Light.Radius + 1);
+        Shadowcast(Light.x, Light.y, Light.Radius, [&](int x, int y, int dx, int dy)
+        {
+            const float falloff = 1.0f - sqrtf((float)(dx * dx + dy * dy)) * fade;
+            Light.Contribution[(size_t)(y - Light.BoxY) * Light.BoxSize + (x - Light.BoxX)] = (uint8_t)(Light.Intensity * falloff);
+        });
+    }
+
+    // Add or subtract contribution of the light, sums are exact so removing needs no neighbours
+    void Accumulate(LightSource& Light, bool Add)
+    {
+        const int x1 = std::max(Light.BoxX, 0), x2 = std::min(Light.BoxX + Light.BoxSize, m_Width);
+        const int y1 = std::max(Light.BoxY, 0), y2 = std::min(Light.BoxY + Light.BoxSize, m_Height);
+        for (int y = y1; y < y2; ++y)
+        {
+            const uint8_t* from = Light.Contribution.data() + (size_t)(y - Light.BoxY) * Light.BoxSize - Light.BoxX;
+            uint32_t* to = m_Light.data() + (size_t)y * m_Width;
+            for (int x = x1; x < x2; ++x)
+                to[x] = Add ? to[x] + from[x] : to[x] - from[x];
+        }
+        Light.Applied = Add;
+    }
+
+    void CastView()
+    {
+        // Only the box of the previous view is cleared
+        for (int y = std::max(m_ViewBoxY1, 0); y < std::min(m_ViewBoxY2, m_Height); ++y)
+            for (int x = std::max(m_ViewBoxX1, 0); x < std::min(m_ViewBoxX2, m_Width); ++x)
+                m_Visible[Index(x, y)] = 0;
+        m_ViewBoxX1 = m_ViewBoxY1 = m_ViewBoxX2 = m_ViewBoxY2 = 0;
+        m_ViewerDirty = false;
+        if (!m_HasViewer)
+            return;
+
+        Shadowcast(m_ViewerX, m_ViewerY, m_ViewerRadius, [this](int x, int y, int, int) { m_Visible[Index(x, y)] = 1; });
+        m_ViewBoxX1 = m_ViewerX - m_ViewerRadius;
+        m_ViewBoxY1 = m_ViewerY - m_ViewerRadius;
+        m_ViewBoxX2 = m_ViewerX + m_ViewerRadius + 1;
+        m_ViewBoxY2 = m_ViewerY + m_ViewerRadius + 1;
+    }
+
+    ///<summary> Call Visit(x, y, dx, dy) for the origin and every cell within Radius seen from it </summary>
+    ///<remarks> Opaque cells are visited, cells behind them are not. Cells on octant borders may be visited twice </remarks>
+    template < typename VisitFunc >
+    void Shadowcast(int x, int y, int Radius, VisitFunc&& Visit) const
+    {
+        if (!Inside(x, y))
+            return;
+        Visit(x, y, 0, 0);
+        // Transforms of octant coordinates to grid offsets
+        static const int octants[8][4] =
+        {
+            { 1, 0, 0, 1 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { -1, 0, 0, 1 },
+            { -1, 0, 0, -1 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 }, { 1, 0, 0, -1 }
+        };
+        for (const int* o : octants)
+            CastOctant(x, y, Radius, 1, 1.0f, 0.0f, o[0], o[1], o[2], o[3], Visit);
+    }
+
+    // Scan rows of one octant, every opaque run splits the visible slope range in two
+    template < typename VisitFunc >
+    void CastOctant(int cx, int cy, int Radius, int Row, float Start, float End, int xx, int xy, int yx, int yy, VisitFunc& Visit) const
+    {
+        if (Start < End)
+            return;
+        const int radius_squared = Radius * Radius + Radius;
+        float next_start = Start;
+        for (int j = Row; j <= Radius; ++j)
+        {
+            bool blocked = false;
+            const int dy = -j;
+            for (int dx = -j; dx <= 0; ++dx)
+            {
+                const float left = (dx - 0.5f) / (dy + 0.5f);
+                const float right = (dx + 0.5f) / (dy - 0.5f);
+                if (Start < right)
+                    continue;
+                if (End > left)
+                    break;
+
+                const int ox = dx * xx + dy * xy, oy = dx * yx + dy * yy;
+                const int x = cx + ox, y = cy + oy;
+                const bool opaque = IsOpaque(x, y);
+                if (Inside(x, y) && dx * dx + dy * dy <= radius_squared)
+                    Visit(x, y, ox, oy);
+
+                if (blocked)
+                {
+                    if (opaque)
+                    {
+                        next_start = right;
+                        continue;
+                    }
+                    blocked = false;
+                    Start = next_start;
+                }
+                else if (opaque && j < Radius)
+                {
+                    blocked = true;
+                    CastOctant(cx, cy, Radius, j + 1, Start, left, xx, xy, yx, yy, Visit);
+                    next_start = right;
+                }
+            }
+            if (blocked)
+                break;
+        }
+    }
+
+    // Bright colors lose intensity first, then become dark grey, then black
+    void Dim(Pixel& Cell, int Level) const
+    {
+        const int step = Level * CE_LIGHT_DIM_LEVELS / 256;
+        Cell.Attributes = (Cell.Attributes & ~0xFF) | m_Dim[step][Cell.Attributes & 0xFF];
+        if (step == 0)
+            Cell.Char.UnicodeChar = L' ';
+    }
+
+    void BuildDimTable()
+    {
+        for (int attribute = 0; attribute < 256; ++attribute)
+        {
+            const int foreground = attribute & 0x0F, background = attribute >> 4;
+            m_Dim[0][attribute] = 0;
+            m_Dim[1][attribute] = (uint8_t)((foreground ? FG_DARK_GREY : 0) | (background ? BG_DARK_GREY : 0));
+            m_Dim[2][attribute] = (uint8_t)((foreground & 0x07) | ((background & 0x07) << 4));
+            m_Dim[3][attribute] = (uint8_t)attribute;
+        }
+        static_assert(CE_LIGHT_DIM_LEVELS == 4, "Dim table has four levels");
+    }
+
+    int m_Width = 0, m_Height = 0;
+    std::vector<uint8_t> m_Opaque;
+    std::vector<uint32_t> m_Light;      // Exact sums of light contributions
+    std::vector<uint8_t> m_Visible;
+    std::vector<LightSource> m_Lights;
+    uint8_t m_Ambient = 0;
+
+    bool m_HasViewer = false, m_ViewerDirty = false;
+    int m_ViewerX = 0, m_ViewerY = 0, m_ViewerRadius = 0;
+    int m_ViewBoxX1 = 0, m_ViewBoxY1 = 0, m_ViewBoxX2 = 0, m_ViewBoxY2 = 0;
+
+    uint8_t m_Dim[CE_LIGHT_DIM_LEVELS][256];
+};
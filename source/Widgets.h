@@ -0,0 +1,959 @@
+#pragma once
+
+#include <stf/ConsoleEngine.h>
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <functional>
+
+// Direction in which BoxLayout places its children
+enum class ORIENTATION : short
+{
+    VERTICAL = 0x0,
+    HORIZONTAL
+};
+
+// Cells occupied by widget on the screen
+struct WidgetRect
+{
+    int x = 0, y = 0;
+    int Width = 0, Height = 0;
+
+    bool Contains(int px, int py) const { return px >= x && px < x + Width && py >= y && py < y + Height; }
+    bool operator==(const WidgetRect& Other) const { return x == Other.x && y == Other.y && Width == Other.Width && Height == Other.Height; }
+    bool operator!=(const WidgetRect& Other) const { return !(*this == Other); }
+};
+
+///<summary> Node of retained widget tree, drawn again only after it was invalidated </summary>
+///<remarks> Screen buffer keeps the picture between frames, so unchanged widgets cost nothing.
+///          Widget draws its whole rect in Render(), children are drawn after their parent </remarks>
+class Widget
+{
+public:
+    virtual ~Widget() = default;
+
+    // Create child owned by this widget, pointer stays valid while the widget lives
+    template < typename T, typename ... Args >
+    T* Add(Args&& ... args)
+    {
+        T* child = new T(std::forward<Args>(args)...);
+        child->m_Parent = this;
+        m_Children.emplace_back(child);
+        InvalidateLayout();
+        return child;
+    }
+
+    Widget* Parent() const { return m_Parent; }
+    const std::vector<std::unique_ptr<Widget>>& Children() const { return m_Children; }
+    const WidgetRect& Rect() const { return m_Rect; }
+
+    /* Hints for layout containers */
+public:
+    // Cells along the axis of container, zero shares free space by weight
+    void SetFixedSize(int Size)
+    {
+        if (m_FixedSize != Size)
+        {
+            m_FixedSize = Size;
+            InvalidateParentLayout();
+        }
+    }
+    int FixedSize() const { return m_FixedSize; }
+    void SetWeight(int Weight)
+    {
+        if (m_Weight != Weight)
+        {
+            m_Weight = Weight;
+            InvalidateParentLayout();
+        }
+    }
+    int Weight() const { return m_Weight; }
+
+    void SetVisible(bool Visible)
+    {
+        if (m_Visible != Visible)
+        {
+            m_Visible = Visible;
+            InvalidateParentLayout();
+            // Layout may keep every rect, parent still has to cover or uncover the area
+            if (m_Parent)
+                m_Parent->Invalidate();
+            Invalidate();
+        }
+    }
+    bool Visible() const { return m_Visible; }
+
+    // Color that base Render() fills the rect with, also used by widgets for empty cells
+    void SetBackground(short Color)
+    {
+        if (m_Background != Color)
+        {
+            m_Background = Color;
+            Invalidate();
+        }
+    }
+    short Background() const { return m_Background; }
+
+    /* Dirty tracking */
+public:
+    // Whole widget and its children are drawn on the next UIRoot::Render()
+    void Invalidate()
+    {
+        m_Dirty = true;
+        MarkAncestors(&Widget::m_ChildDirty);
+    }
+    // Only RenderChanges() is called, e.g. for one row of a list
+    void InvalidateChanges()
+    {
+        m_ChangesDirty = true;
+        MarkAncestors(&Widget::m_ChildDirty);
+    }
+    // Layout() places children again on the next UIRoot::Render()
+    void InvalidateLayout()
+    {
+        m_LayoutDirty = true;
+        MarkAncestors(&Widget::m_ChildLayoutDirty);
+    }
+    bool NeedsRender() const { return m_Dirty || m_ChangesDirty || m_ChildDirty; }
+
+    /* Input, handlers return true when event is consumed, otherwise it goes to the parent */
+public:
+    virtual bool Focusable() const { return false; }
+    bool Focused() const { return m_Focused; }
+
+    // Character is the typed one, zero for keys without characters
+    virtual bool OnKey(KEY Key, wchar_t Character) { return false; }
+    // Point is relative to the top left corner of the widget
+    virtual bool OnClick(int x, int y) { return false; }
+    // Positive is forward
+    virtual bool OnWheel(int Notches) { return false; }
+    virtual void OnFocus(bool Focused) {}
+
+protected:
+    ///<summary> Draw the whole rect, clip of target is set to the visible part of it </summary>
+    virtual void Render(Canvas& Target)
+    {
+        Target.DrawBox(m_Rect.x, m_Rect.y, m_Rect.Width, m_Rect.Height, L' ', m_Background);
+    }
+    // Draw only what changed since the last call, widgets that use InvalidateChanges() override it
+    virtual void RenderChanges(Canvas& Target) { Render(Target); }
+
+    ///<summary> Place children inside Rect() with SetChildRect(), by default all of them get the whole rect </summary>
+    virtual void Layout()
+    {
+        for (auto& child : m_Children)
+            SetChildRect(*child, m_Rect);
+    }
+
+    // Moved or resized child is laid out again, container is redrawn since the old area may be uncovered
+    void SetChildRect(Widget& Child, const WidgetRect& Rect)
+    {
+        if (Child.m_Rect == Rect)
+            return;
+        Child.m_Rect = Rect;
+        Child.m_LayoutDirty = true;
+        m_ChildLayoutDirty = true;
+        Invalidate();
+    }
+
+    // Write Length characters padded with spaces to Width cells as one clipped span
+    static void DrawText(Canvas& Target, int x, int y, int Width, const wchar_t* Text, size_t Length, short Color)
+    {
+        if (Width <= 0)
+            return;
+        thread_local std::vector<Pixel> Span;
+        Span.resize(Width);
+        for (int i = 0; i < Width; ++i)
+        {
+            Span[i].Char.UnicodeChar = (size_t)i < Length ? Text[i] : L' ';
+            Span[i].Attributes = Color;
+        }
+        Target.DrawSpan(x, y, Span.data(), Width);
+    }
+    static void DrawText(Canvas& Target, int x, int y, int Width, const std::wstring& Text, short Color)
+    {
+        DrawText(Target, x, y, Width, Text.c_str(), Text.size(), Color);
+    }
+
+private:
+    friend class UIRoot;
+
+    void MarkAncestors(bool Widget::* Flag)
+    {
+        for (Widget* parent = m_Parent; parent; parent = parent->m_Parent)
+            parent->*Flag = true;
+    }
+    void InvalidateParentLayout()
+    {
+        if (m_Parent)
+            m_Parent->InvalidateLayout();
+    }
+
+    void RunLayout()
+    {
+        if (m_LayoutDirty)
+        {
+            m_LayoutDirty = false;
+            Layout();
+        }
+        if (m_ChildLayoutDirty)
+        {
+            m_ChildLayoutDirty = false;
+            for (auto& child : m_Children)
+                if (child->m_LayoutDirty || child->m_ChildLayoutDirty)
+                    child->RunLayout();
+        }
+    }
+
+    // Force means that parent was drawn over the widget
+    void Paint(Canvas& Target, const ClipRect& Bounds, bool Force, size_t& Drawn)
+    {
+        // Hidden widget keeps its flags, so it's drawn when shown again
+        if (!m_Visible)
+            return;
+        const bool full = Force || m_Dirty;
+        const bool changes = !full && m_ChangesDirty;
+        const bool children = full || m_ChildDirty;
+        m_Dirty = m_ChangesDirty = m_ChildDirty = false;
+        if (!(full || changes || children))
+            return;
+
+        ClipRect clip;
+        clip.Left = std::max(Bounds.Left, m_Rect.x);
+        clip.Top = std::max(Bounds.Top, m_Rect.y);
+        clip.Right = std::min(Bounds.Right, m_Rect.x + m_Rect.Width);
+        clip.Bottom = std::min(Bounds.Bottom, m_Rect.y + m_Rect.Height);
+        if (clip.Empty())
+            return;
+
+        if (full || changes)
+        {
+            Target.GetRenderTarget().SetClip(clip.Left, clip.Top, clip.Right, clip.Bottom);
+            if (full)
+                Render(Target);
+            else
+                RenderChanges(Target);
+            ++Drawn;
+        }
+        if (children)
+            for (auto& child : m_Children)
+                child->Paint(Target, clip, full, Drawn);
+    }
+
+    Widget* m_Parent = nullptr;
+    std::vector<std::unique_ptr<Widget>> m_Children;
+    WidgetRect m_Rect;
+    int m_FixedSize = 0;
+    int m_Weight = 1;
+    short m_Background = BG_BLACK;
+    bool m_Visible = true;
+    bool m_Focused = false;
+
+    bool m_Dirty = true;                // Render() is needed
+    bool m_ChangesDirty = false;        // RenderChanges() is needed
+    bool m_ChildDirty = false;          // Some descendant needs drawing
+    bool m_LayoutDirty = true;          // Layout() is needed
+    bool m_ChildLayoutDirty = false;    // Some descendant needs layout
+};
+
+/* Row or column of children, fixed sizes first and the rest split by weights */
+class BoxLayout : public Widget
+{
+public:
+    explicit BoxLayout(ORIENTATION Orientation = ORIENTATION::VERTICAL, int Spacing = 0)
+        : m_Orientation(Orientation), m_Spacing(Spacing) {}
+
+protected:
+    void Layout() override
+    {
+        const bool vertical = m_Orientation == ORIENTATION::VERTICAL;
+        const WidgetRect& rect = Rect();
+        int free_space = vertical ? rect.Height : rect.Width;
+        int weights = 0, count = 0;
+        for (auto& child : Children())
+            if (child->Visible())
+            {
+                free_space -= child->FixedSize() + (count++ ? m_Spacing : 0);
+                weights += child->FixedSize() ? 0 : child->Weight();
+            }
+        free_space = std::max(free_space, 0);
+
+        int offset = 0, shared = 0;
+        for (auto& child : Children())
+        {
+            if (!child->Visible())
+                continue;
+            int size = child->FixedSize();
+            if (!size && weights)
+            {
+                // Rounding error goes to the last weighted child
+                int before = shared;
+                shared += child->Weight();
+                size = free_space * shared / weights - free_space * before / weights;
+            }
+            WidgetRect place = rect;
+            if (vertical)
+            {
+                place.y += offset;
+                place.Height = std::max(0, std::min(size, rect.Height - offset));
+            }
+            else
+            {
+                place.x += offset;
+                place.Width = std::max(0, std::min(size, rect.Width - offset));
+            }
+            SetChildRect(*child, place);
+            offset += size + m_Spacing;
+        }
+    }
+
+private:
+    ORIENTATION m_Orientation;
+    int m_Spacing;
+};
+
+/* Frame with title, children are placed inside the frame */
+class Panel : public Widget
+{
+public:
+    explicit Panel(const std::wstring& Title = L"", short Color = FG_WHITE) : m_Title(Title), m_Color(Color) {}
+
+    void SetTitle(const std::wstring& Title)
+    {
+        if (m_Title != Title)
+        {
+            m_Title = Title;
+            Invalidate();
+        }
+    }
+
+protected:
+    void Render(Canvas& Target) override
+    {
+        const WidgetRect& r = Rect();
+        const short color = m_Color | Background();
+        Target.DrawBox(r.x + 1, r.y + 1, r.Width - 2, r.Height - 2, L' ', Background());
+        Target.DrawRect(r.x + 1, r.y, r.x + r.Width - 1, r.y + 1, BOXSHAPE::HOR, color);
+        Target.DrawRect(r.x + 1, r.y + r.Height - 1, r.x + r.Width - 1, r.y + r.Height, BOXSHAPE::HOR, color);
+        Target.DrawRect(r.x, r.y + 1, r.x + 1, r.y + r.Height - 1, BOXSHAPE::VER, color);
+        Target.DrawRect(r.x + r.Width - 1, r.y + 1, r.x + r.Width, r.y + r.Height - 1, BOXSHAPE::VER, color);
+        Target.DrawPixel(r.x, r.y, BOXSHAPE::L_UP, color);
+        Target.DrawPixel(r.x + r.Width - 1, r.y, BOXSHAPE::R_UP, color);
+        Target.DrawPixel(r.x, r.y + r.Height - 1, BOXSHAPE::L_DOWN, color);
+        Target.DrawPixel(r.x + r.Width - 1, r.y + r.Height - 1, BOXSHAPE::R_DOWN, color);
+        if (!m_Title.empty() && r.Width > 4)
+            DrawText(Target, r.x + 2, r.y, (int)std::min(m_Title.size(), (size_t)r.Width - 4), m_Title, color);
+    }
+
+    void Layout() override
+    {
+        const WidgetRect& r = Rect();
+        WidgetRect inner = { r.x + 1, r.y + 1, std::max(r.Width - 2, 0), std::max(r.Height - 2, 0) };
+        for (auto& child : Children())
+            SetChildRect(*child, inner);
+    }
+
+private:
+    std::wstring m_Title;
+    short m_Color;
+};
+
+/* One line of text */
+class Label : public Widget
+{
+public:
+    explicit Label(const std::wstring& Text = L"", short Color = FG_WHITE) : m_Text(Text), m_Color(Color) {}
+
+    // Widget is drawn again only if text or color really changed
+    void SetText(const std::wstring& Text)
+    {
+        if (m_Text != Text)
+        {
+            m_Text = Text;
+            Invalidate();
+        }
+    }
+    const std::wstring& Text() const { return m_Text; }
+    void SetColor(short Color)
+    {
+        if (m_Color != Color)
+        {
+            m_Color = Color;
+            Invalidate();
+        }
+    }
+
+protected:
+    void Render(Canvas& Target) override
+    {
+        const WidgetRect& r = Rect();
+        Widget::Render(Target);
+        DrawText(Target, r.x, r.y, r.Width, m_Text, m_Color | Background());
+    }
+
+private:
+    std::wstring m_Text;
+    short m_Color;
+};
+
+///<summary> Scrollable list of any size, text of items is asked only for visible rows </summary>
+class ListView : public Widget
+{
+public:
+    typedef std::function<std::wstring(size_t Index)> ItemText;
+
+    explicit ListView(ItemText Source = nullptr, size_t Count = 0) : m_Source(std::move(Source)), m_Count(Count) {}
+
+    void SetItems(ItemText Source, size_t Count)
+    {
+        m_Source = std::move(Source);
+        m_Count = Count;
+        m_Selected = std::min(m_Selected, Count ? Count - 1 : 0);
+        Invalidate();
+    }
+    void SetItemCount(size_t Count)
+    {
+        if (m_Count == Count)
+            return;
+        m_Count = Count;
+        m_Selected = std::min(m_Selected, Count ? Count - 1 : 0);
+        m_First = std::min(m_First, MaxFirst());
+        Invalidate();
+    }
+    size_t ItemCount() const { return m_Count; }
+
+    // Content of one item changed, only its row is drawn again and only if visible
+    void InvalidateItem(size_t Index)
+    {
+        if (Index < m_First || Index >= m_First + VisibleRows())
+            return;
+        if (std::find(m_DirtyRows.begin(), m_DirtyRows.end(), Index) != m_DirtyRows.end())
+            return;
+        m_DirtyRows.push_back(Index);
+        // As many rows as the list shows were changed between frames, so it's drawn whole
+        if (m_DirtyRows.size() >= VisibleRows())
+        {
+            m_DirtyRows.clear();
+            Invalidate();
+            return;
+        }
+        InvalidateChanges();
+    }
+
+    // Select item and scroll so it's visible
+    void Select(size_t Index)
+    {
+        if (m_Count == 0)
+            return;
+        Index = std::min(Index, m_Count - 1);
+        if (Index == m_Selected)
+            return;
+        InvalidateItem(m_Selected);
+        m_Selected = Index;
+        const size_t rows = std::max(VisibleRows(), (size_t)1);
+        if (Index < m_First)
+            ScrollTo(Index);
+        else if (Index >= m_First + rows)
+            ScrollTo(Index - rows + 1);
+        InvalidateItem(m_Selected);
+        if (OnSelect)
+            OnSelect(m_Selected);
+    }
+    size_t Selected() const { return m_Selected; }
+
+    void ScrollTo(size_t First)
+    {
+        First = std::min(First, MaxFirst());
+        if (First != m_First)
+        {
+            m_First = First;
+            Invalidate();
+        }
+    }
+    size_t FirstVisible() const { return m_First; }
+
+    void SetColors(short Normal, short Selected)
+    {
+        m_Normal = Normal;
+        m_Highlight = Selected;
+        Invalidate();
+    }
+
+    std::function<void(size_t Index)> OnSelect;     // Selection changed
+    std::function<void(size_t Index)> OnActivate;   // Enter pressed or selected item clicked
+
+    bool Focusable() const override { return true; }
+
+    bool OnKey(KEY Key, wchar_t) override
+    {
+        const size_t page = std::max(VisibleRows(), (size_t)1);
+        switch (Key)
+        {
+        case KEY::UP: Select(m_Selected ? m_Selected - 1 : 0); return true;
+        case KEY::DOWN: Select(m_Selected + 1); return true;
+        case KEY::PAGE_UP: Select(m_Selected > page ? m_Selected - page : 0); return true;
+        case KEY::PAGE_DOWN: Select(m_Selected + page); return true;
+        case KEY::HOME: Select(0); return true;
+        case KEY::END: Select(m_Count ? m_Count - 1 : 0); return true;
+        case KEY::ENTER:
+            if (OnActivate && m_Count)
+                OnActivate(m_Selected);
+            return true;
+        default: return false;
+        }
+    }
+    bool OnClick(int, int y) override
+    {
+        if (y < HeaderRows())
+            return true;
+        size_t index = m_First + (y - HeaderRows());
+        if (index >= m_Count)
+            return true;
+        if (index == m_Selected && OnActivate)
+            OnActivate(index);
+        Select(index);
+        return true;
+    }
+    bool OnWheel(int Notches) override
+    {
+        size_t step = (size_t)std::abs(Notches) * 3;
+        ScrollTo(Notches > 0 ? (m_First > step ? m_First - step : 0) : m_First + step);
+        return true;
+    }
+    void OnFocus(bool) override { InvalidateItem(m_Selected); }
+
+protected:
+    // Rows above items that scroll does not move
+    virtual int HeaderRows() const { return 0; }
+    virtual void RenderHeader(Canvas& Target) {}
+    virtual void RenderRow(Canvas& Target, size_t Index, int y, short Color)
+    {
+        const WidgetRect& r = Rect();
+        DrawText(Target, r.x, y, r.Width, m_Source ? m_Source(Index) : std::wstring(), Color);
+    }
+
+    void Render(Canvas& Target) override
+    {
+        m_DirtyRows.clear();
+        RenderHeader(Target);
+        const WidgetRect& r = Rect();
+        for (int row = HeaderRows(); row < r.Height; ++row)
+        {
+            size_t index = m_First + (row - HeaderRows());
+            if (index < m_Count)
+                RenderRow(Target, index, r.y + row, RowColor(index));
+            else
+                Target.DrawBox(r.x, r.y + row, r.Width, 1, L' ', Background());
+        }
+    }
+    void RenderChanges(Canvas& Target) override
+    {
+        for (size_t index : m_DirtyRows)
+            if (index >= m_First && index < m_First + VisibleRows() && index < m_Count)
+                RenderRow(Target, index, Rect().y + HeaderRows() + (int)(index - m_First), RowColor(index));
+        m_DirtyRows.clear();
+    }
+
+    void Layout() override
+    {
+        Widget::Layout();
+        m_First = std::min(m_First, MaxFirst());
+    }
+
+    short RowColor(size_t Index) const
+    {
+        if (Index == m_Selected)
+            return Focused() ? m_Highlight : (short)((m_Highlight & 0x0F) | BG_DARK_GREY);
+        return (short)(m_Normal | Background());
+    }
+    size_t VisibleRows() const { return (size_t)std::max(Rect().Height - HeaderRows(), 0); }
+    size_t MaxFirst() const { return m_Count > VisibleRows() ? m_Count - VisibleRows() : 0; }
+
+private:
+    ItemText m_Source;
+    size_t m_Count = 0;
+    size_t m_First = 0;
+    size_t m_Selected = 0;
+    short m_Normal = FG_GREY;
+    short m_Highlight = FG_BLACK | BG_GREY;
+    std::vector<size_t> m_DirtyRows;    // Rows for RenderChanges()
+};
+
+/* List with columns and header, cell text is asked only for visible rows */
+class TableView : public ListView
+{
+public:
+    struct Column
+    {
+        std::wstring Header;
+        int Width = 0;          // Zero shares the rest of the width
+    };
+    typedef std::function<std::wstring(size_t Row, size_t Column)> CellText;
+
+    TableView(std::vector<Column> Columns, CellText Source = nullptr, size_t Rows = 0)
+        : ListView(nullptr, Rows), m_Columns(std::move(Columns)), m_Source(std::move(Source)) {}
+
+    void SetCells(CellText Source, size_t Rows)
+    {
+        m_Source = std::move(Source);
+        SetItems(nullptr, Rows);
+    }
+    void SetHeaderColor(short Color)
+    {
+        m_HeaderColor = Color;
+        Invalidate();
+    }
+
+protected:
+    int HeaderRows() const override { return 1; }
+
+    void RenderHeader(Canvas& Target) override
+    {
+        const WidgetRect& r = Rect();
+        for (size_t c = 0; c < m_Columns.size(); ++c)
+            DrawCell(Target, c, r.y, m_Columns[c].Header, m_HeaderColor);
+    }
+    void RenderRow(Canvas& Target, size_t Index, int y, short Color) override
+    {
+        for (size_t c = 0; c < m_Columns.size(); ++c)
+            DrawCell(Target, c, y, m_Source ? m_Source(Index, c) : std::wstring(), Color);
+    }
+
+    void Layout() override
+    {
+        ListView::Layout();
+        const int width = Rect().Width;
+        int fixed = 0, shared = 0;
+        for (const Column& column : m_Columns)
+        {
+            fixed += column.Width + 1;
+            shared += column.Width == 0;
+        }
+        int rest = std::max(width - fixed, 0);
+        m_Offsets.resize(m_Columns.size() + 1);
+        m_Offsets[0] = 0;
+        for (size_t c = 0, i = 0; c < m_Columns.size(); ++c)
+        {
+            int size = m_Columns[c].Width;
+            if (size == 0)
+            {
+                size = rest * (int)(i + 1) / shared - rest * (int)i / shared;
+                ++i;
+            }
+            m_Offsets[c + 1] = m_Offsets[c] + size + 1;
+        }
+        Invalidate();
+    }
+
+private:
+    // Cell text and separator after it
+    void DrawCell(Canvas& Target, size_t Column, int y, const std::wstring& Text, short Color)
+    {
+        const int x = Rect().x + m_Offsets[Column];
+        const int width = m_Offsets[Column + 1] - m_Offsets[Column] - 1;
+        DrawText(Target, x, y, width, Text, Color);
+        Target.DrawPixel(x + width, y, BOXSHAPE::VER, Color);
+    }
+
+    std::vector<Column> m_Columns;
+    std::vector<int> m_Offsets;         // Start of every column relative to the table
+    CellText m_Source;
+    short m_HeaderColor = FG_WHITE | BG_DARK_BLUE;
+};
+
+/* Single line text field fed by UIRoot from the key buffer of the engine */
+class TextInput : public Widget
+{
+public:
+    explicit TextInput(size_t MaxLength = 256, short Color = FG_WHITE | BG_DARK_GREY) : m_MaxLength(MaxLength), m_Color(Color) {}
+
+    const std::wstring& Text() const { return m_Text; }
+    void SetText(const std::wstring& Text)
+    {
+        m_Text = Text.substr(0, m_MaxLength);
+        m_Cursor = m_Text.size();
+        Invalidate();
+    }
+
+    std::function<void(const std::wstring&)> OnChange;
+    std::function<void(const std::wstring&)> OnSubmit;     // Enter pressed
+
+    bool Focusable() const override { return true; }
+    void OnFocus(bool) override { Invalidate(); }
+
+    bool OnKey(KEY Key, wchar_t Character) override
+    {
+        const std::wstring before = m_Text;
+        const size_t cursor = m_Cursor;
+        switch (Key)
+        {
+        case KEY::LEFT: m_Cursor -= m_Cursor > 0; break;
+        case KEY::RIGHT: m_Cursor += m_Cursor < m_Text.size(); break;
+        case KEY::HOME: m_Cursor = 0; break;
+        case KEY::END: m_Cursor = m_Text.size(); break;
+        case KEY::BACKSPACE:
+            if (m_Cursor > 0)
+                m_Text.erase(--m_Cursor, 1);
+            break;
+        case KEY::DEL:
+            if (m_Cursor < m_Text.size())
+                m_Text.erase(m_Cursor, 1);
+            break;
+        case KEY::ENTER:
+            if (OnSubmit)
+                OnSubmit(m_Text);
+            return true;
+        default:
+            if (!Character)
+                return false;
+            if (m_Text.size() < m_MaxLength)
+                m_Text.insert(m_Cursor++, 1, Character);
+            break;
+        }
+        if (m_Text != before && OnChange)
+            OnChange(m_Text);
+        if (m_Text != before || m_Cursor != cursor)
+            Invalidate();
+        return true;
+    }
+    bool OnClick(int x, int) override
+    {
+        size_t cursor = std::min(m_Scroll + (size_t)x, m_Text.size());
+        if (cursor != m_Cursor)
+        {
+            m_Cursor = cursor;
+            Invalidate();
+        }
+        return true;
+    }
+
+protected:
+    void Render(Canvas& Target) override
+    {
+        const WidgetRect& r = Rect();
+        // Scroll horizontally just enough to keep cursor visible
+        const size_t width = (size_t)std::max(r.Width, 1);
+        if (m_Cursor < m_Scroll)
+            m_Scroll = m_Cursor;
+        else if (m_Cursor >= m_Scroll + width)
+            m_Scroll = m_Cursor - width + 1;
+
+        DrawText(Target, r.x, r.y, r.Width, m_Text.c_str() + m_Scroll, m_Text.size() - m_Scroll, m_Color);
+        if (Focused())
+        {
+            // Cursor is the cell with swapped colors
+            const short inverted = (short)(((m_Color & 0x0F) << 4) | ((m_Color & 0xF0) >> 4));
+            const wchar_t under = m_Cursor < m_Text.size() ? m_Text[m_Cursor] : L' ';
+            Target.DrawPixel(r.x + (int)(m_Cursor - m_Scroll), r.y, under, inverted);
+        }
+    }
+
+private:
+    std::wstring m_Text;
+    size_t m_MaxLength;
+    size_t m_Cursor = 0;
+    size_t m_Scroll = 0;
+    short m_Color;
+};
+
+///<summary> Owner of widget tree: routes input, lays out and draws only invalidated widgets </summary>
+///<remarks> Call HandleInput() and Render() every frame in Update(), InvalidateAll() after screen was
+///          cleared or drawn over, e.g. in OnResize() </remarks>
+class UIRoot
+{
+public:
+    // Root widget covers rect of UIRoot
+    template < typename T, typename ... Args >
+    T* SetRoot(Args&& ... args)
+    {
+        SetFocus(nullptr);
+        T* root = new T(std::forward<Args>(args)...);
+        m_Root.reset(root);
+        m_Root->m_Rect = m_Rect;
+        m_Root->InvalidateLayout();
+        m_Root->Invalidate();
+        return root;
+    }
+    Widget* Root() const { return m_Root.get(); }
+
+    void SetRect(int x, int y, int Width, int Height)
+    {
+        m_Rect = { x, y, Width, Height };
+        if (m_Root && m_Root->m_Rect != m_Rect)
+        {
+            m_Root->m_Rect = m_Rect;
+            m_Root->InvalidateLayout();
+            m_Root->Invalidate();
+        }
+    }
+
+    void InvalidateAll()
+    {
+        if (m_Root)
+            m_Root->Invalidate();
+    }
+
+    /* Focus */
+public:
+    void SetFocus(Widget* Focus)
+    {
+        if (Focus == m_Focus)
+            return;
+        if (m_Focus)
+        {
+            m_Focus->m_Focused = false;
+            m_Focus->OnFocus(false);
+        }
+        m_Focus = Focus;
+        if (m_Focus)
+        {
+            m_Focus->m_Focused = true;
+            m_Focus->OnFocus(true);
+        }
+    }
+    Widget* Focus() const { return m_Focus; }
+
+    // Next visible focusable widget in tree order, wraps around
+    void FocusNext()
+    {
+        std::vector<Widget*> focusable;
+        CollectFocusable(m_Root.get(), focusable);
+        if (focusable.empty())
+            return;
+        auto it = std::find(focusable.begin(), focusable.end(), m_Focus);
+        SetFocus(it == focusable.end() || ++it == focusable.end() ? focusable.front() : *it);
+    }
+
+    /* Input */
+public:
+    ///<summary> Feed keys, clicks and wheel of the frame from the engine </summary>
+    void HandleInput(ConsoleEngine& Engine)
+    {
+        // Keyboard hook sees keys typed into other windows too
+        if (!Engine.InFocus())
+            return;
+        const bool shift = Engine.GetKey(KEY::LSHIFT).Held || Engine.GetKey(KEY::RSHIFT).Held;
+        for (const KeyInfo& info : Engine.GetInputBuffer())
+            // Held comes with autorepeat of pressed key
+            if (info.State.Pressed || info.State.Held)
+                HandleKey(info.Key, KeyCharacter(info.Key, shift));
+
+        if (Engine.GetMouseButton(BUTTON::LEFT).Pressed)
+            HandleClick(Engine.GetMouseX(), Engine.GetMouseY());
+
+        int wheel = Engine.GetMouseWheel();
+        if (wheel != 0)
+            HandleWheel(Engine.GetMouseX(), Engine.GetMouseY(), wheel / 120 ? wheel / 120 : (wheel > 0 ? 1 : -1));
+    }
+
+    bool HandleKey(KEY Key, wchar_t Character)
+    {
+        for (Widget* widget = m_Focus; widget; widget = widget->Parent())
+            if (widget->OnKey(Key, Character))
+                return true;
+        if (Key == KEY::TAB)
+        {
+            FocusNext();
+            return true;
+        }
+        return false;
+    }
+    bool HandleClick(int x, int y)
+    {
+        Widget* hit = HitTest(m_Root.get(), x, y);
+        for (Widget* widget = hit; widget; widget = widget->Parent())
+            if (widget->Focusable())
+            {
+                SetFocus(widget);
+                break;
+            }
+        for (Widget* widget = hit; widget; widget = widget->Parent())
+            if (widget->OnClick(x - widget->Rect().x, y - widget->Rect().y))
+                return true;
+        return false;
+    }
+    bool HandleWheel(int x, int y, int Notches)
+    {
+        for (Widget* widget = HitTest(m_Root.get(), x, y); widget; widget = widget->Parent())
+            if (widget->OnWheel(Notches))
+                return true;
+        return false;
+    }
+
+    // Character of virtual key for US layout, zero for keys that don't type
+    static wchar_t KeyCharacter(KEY Key, bool Shift)
+    {
+        static const wchar_t Digits[] = L")!@#$%^&*(";
+        static const wchar_t Punctuation[][2] =
+        {
+            { L';', L':' }, { L'=', L'+' }, { L',', L'<' }, { L'-', L'_' }, { L'.', L'>' }, { L'/', L'?' }, { L'`', L'~' }
+        };
+        static const wchar_t Brackets[][2] = { { L'[', L'{' }, { L'\\', L'|' }, { L']', L'}' }, { L'\'', L'"' } };
+
+        const size_t code = (size_t)Key;
+        if (code >= (size_t)KEY::A && code <= (size_t)KEY::Z)
+            return (wchar_t)((Shift ? L'A' : L'a') + (code - (size_t)KEY::A));
+        if (code >= (size_t)KEY::K0 && code <= (size_t)KEY::K9)
+            return Shift ? Digits[code - (size_t)KEY::K0] : (wchar_t)(L'0' + (code - (size_t)KEY::K0));
+        if (code >= (size_t)KEY::NP0 && code <= (size_t)KEY::NP9)
+            return (wchar_t)(L'0' + (code - (size_t)KEY::NP0));
+        if (code >= 0xBA && code <= 0xC0)
+            return Punctuation[code - 0xBA][Shift];
+        if (code >= 0xDB && code <= 0xDE)
+            return Brackets[code - 0xDB][Shift];
+        switch (Key)
+        {
+        case KEY::SPACE: return L' ';
+        case KEY::NP_MUL: return L'*';
+        case KEY::NP_ADD: return L'+';
+        case KEY::NP_SUB: return L'-';
+        case KEY::NP_DECIMAL: return L'.';
+        default: return 0;
+        }
+    }
+
+    /* Drawing */
+public:
+    ///<summary> Lay out and draw widgets invalidated since the last call </summary>
+    ///<returns> Count of widgets that were drawn </returns>
+    size_t Render(Canvas& Target)
+    {
+        if (!m_Root)
+            return 0;
+        m_Root->RunLayout();
+
+        RenderTarget& target = Target.GetRenderTarget();
+        const ClipRect saved = target.Clip();
+        size_t drawn = 0;
+        m_Root->Paint(Target, saved, false, drawn);
+        target.SetClip(saved.Left, saved.Top, saved.Right, saved.Bottom);
+        return drawn;
+    }
+
+private:
+    static Widget* HitTest(Widget* Node, int x, int y)
+    {
+        if (!Node || !Node->Visible() || !Node->Rect().Contains(x, y))
+            return nullptr;
+        // Later children are drawn on top
+        const auto& children = Node->Children();
+        for (auto it = children.rbegin(); it != children.rend(); ++it)
+            if (Widget* hit = HitTest(it->get(), x, y))
+                return hit;
+        return Node;
+    }
+    static void CollectFocusable(Widget* Node, std::vector<Widget*>& Out)
+    {
+        if (!Node || !Node->Visible())
+            return;
+        if (Node->Focusable())
+            Out.push_back(Node);
+        for (auto& child : Node->Children())
+            CollectFocusable(child.get(), Out);
+    }
+
+    std::unique_ptr<Widget> m_Root;
+    WidgetRect m_Rect;
+    Widget* m_Focus = nullptr;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/* Persistent worker threads for fork-join jobs, so frames don't pay for thread creation */
+class WorkerPool
+{
+public:
+    // By default one worker per hardware thread except the calling one
+    WorkerPool() : WorkerPool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0) {}
+    explicit WorkerPool(size_t Workers)
+    {
+        for (size_t i = 0; i < Workers; ++i)
+            m_Threads.emplace_back(&WorkerPool::WorkerThread, this);
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_WakeCondition.notify_all();
+        for (auto& thread : m_Threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Number of threads that execute jobs, including the calling thread
+    size_t Concurrency() const { return m_Threads.size() + 1; }
+
+    ///<summary> Call Job(i) for every i in [0, Count) on workers and calling thread </summary>
+    ///<remarks> Returns when every index is done. Don't call it from inside of a job. </remarks>
+    template < typename Func >
+    void ParallelFor(size_t Count, Func&& Job)
+    {
+        if (Count == 0)
+            return;
+        if (Count == 1 || m_Threads.empty())
+        {
+            for (size_t i = 0; i < Count; ++i)
+                Job(i);
+            return;
+        }
+
+        {
+            // Previous job stragglers must leave before indices are reset
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_DoneCondition.wait(lock, [this] { return m_Active == 0; });
+            m_Context = &Job;
+            m_Invoke = [](void* Context, size_t Index) { (*static_cast<Func*>(Context))(Index); };
+            m_Count = Count;
+            m_Next = 0;
+            ++m_Generation;
+        }
+        m_WakeCondition.notify_all();
+
+        Execute(&Job, m_Invoke, Count);
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_DoneCondition.wait(lock, [this] { return m_Active == 0; });
+    }
+
+private:
+    typedef void(*InvokeFunc)(void*, size_t);
+
+    void Execute(void* Context, InvokeFunc Invoke, size_t Count)
+    {
+        for (size_t i = m_Next++; i < Count; i = m_Next++)
+            Invoke(Context, i);
+    }
+
+    void WorkerThread()
+    {
+        uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        while (true)
+        {
+            m_WakeCondition.wait(lock, [&] { return m_Stop || m_Generation != seen_generation; });
+            if (m_Stop)
+                return;
+
+            seen_generation = m_Generation;
+            void* context = m_Context;
+            InvokeFunc invoke = m_Invoke;
+            size_t count = m_Count;
+            ++m_Active;
+
+            lock.unlock();
+            Execute(context, invoke, count);
+            lock.lock();
+
+            if (--m_Active == 0)
+                m_DoneCondition.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+
+    void* m_Context = nullptr;
+    InvokeFunc m_Invoke = nullptr;
+    size_t m_Count = 0;
+    std::atomic<size_t> m_Next{ 0 };
+    uint64_t m_Generation = 0;
+    size_t m_Active = 0;
+    bool m_Stop = false;
+};